@@ -0,0 +1,253 @@
+import argparse
+import json
+import os
+import platform
+import signal
+import subprocess
+import sys
+import time
+from datetime import datetime
+
+# Scaling benchmark of multiupdated.cc. Run it from the same directory as vers5.py
+# (four levels below the ns-3 top-level directory):
+#
+#   python3 benchmark.py --output baseline.json
+#   python3 benchmark.py --output current.json --compare baseline.json --threshold 0.1
+#   python3 benchmark.py --validate --output engines.json
+#   python3 benchmark.py --extra=--payload=virtual --output virtual.json --compare baseline.json
+#
+# Every configuration of the matrix uses fixed seeds, so two reports from the same build
+# execute the same events. The comparison flags wall time, events/sec and peak RSS changes
+# that are worse than the threshold and exits with status 1 if any are found; changes that are
+# better than the threshold are listed too, so two option sets can be A/B compared with --extra.
+# --validate runs every 20 MHz configuration with --phyEngine=spectrum and --phyEngine=yans and
+# checks that their aggregate throughputs agree within --tolerance.
+
+# Base configuration, each entry of SCALING then varies one parameter around it
+BASE = {
+    'apNodes': 4,
+    'networkSize': 10,
+    'maxMpdus': 0,
+    'channelWidth': 20,
+    'pktInterval': 1000,
+    'duration': 1,
+    'preassociate': 1,
+    'rng': 1,
+}
+
+SCALING = {
+    'apNodes': [1, 2, 4, 8, 16],
+    'networkSize': [1, 5, 10, 30],
+    'maxMpdus': [0, 16, 64],
+    'channelWidth': [20, 40, 80],
+    'pktInterval': [10000, 1000, 100],
+}
+
+# Metrics compared against the baseline: name -> True if higher is better
+METRICS = {
+    'wall': False,
+    'setup': False,
+    'warmup': False,
+    'measure': False,
+    'eventsPerSecond': True,
+    'maxRssKb': False,
+}
+
+
+def control_c(signum, frame):
+    print("Exiting...")
+    sys.exit(1)
+
+
+signal.signal(signal.SIGINT, control_c)
+
+
+def main():
+    parser = argparse.ArgumentParser(description='Scaling benchmark of multiupdated.cc')
+    parser.add_argument('--program', default='multiupdated',
+                        help='ns-3 program name of multiupdated.cc')
+    parser.add_argument('--output', default='benchmark.json', help='JSON report to write')
+    parser.add_argument('--repeat', type=int, default=1,
+                        help='runs per configuration, the fastest one is reported')
+    parser.add_argument('--only', default='',
+                        help='comma separated parameters of the matrix to run (default: all)')
+    parser.add_argument('--compare', default='', help='baseline report to compare against')
+    parser.add_argument('--threshold', type=float, default=0.1,
+                        help='relative change flagged as a regression (0.1 = 10%%)')
+    parser.add_argument('--extra', default='',
+                        help='options added to every run, e.g. --extra=--payload=virtual')
+    parser.add_argument('--validate', action='store_true',
+                        help='compare the yans PHY engine against spectrum instead')
+    parser.add_argument('--tolerance', type=float, default=0.05,
+                        help='relative throughput difference accepted by --validate')
+    args = parser.parse_args()
+
+    output = os.path.abspath(args.output)
+    commit = git_commit()
+    baseline_path = os.path.abspath(args.compare) if args.compare else ''
+    ns3_path = os.path.join('../../../../ns3')
+    if not os.path.exists(ns3_path):
+        print("Please run this program from within the correct directory.")
+        sys.exit(1)
+    os.chdir('../../../../')
+
+    subprocess.run(['./ns3', 'build', args.program], check=True)
+
+    only = [name for name in args.only.split(',') if name]
+    if args.validate:
+        sys.exit(validate(args.program, only, args.tolerance, output, commit))
+
+    report = {
+        'date': datetime.now().isoformat(timespec='seconds'),
+        'commit': commit,
+        'host': platform.node(),
+        'threshold': args.threshold,
+        'extra': args.extra,
+        'runs': [],
+    }
+    for name, config in configurations(only):
+        best = None
+        for _ in range(args.repeat):
+            result = run(args.program, config, args.extra)
+            if best is None or result['wall'] < best['wall']:
+                best = result
+        best['name'] = name
+        best['config'] = config
+        report['runs'].append(best)
+        print(f"{name}: {best['wall']:.2f} s, {best['eventsPerSecond']:.0f} events/s, "
+              f"{best['maxRssKb']} kB")
+
+    with open(output, 'w') as f:
+        json.dump(report, f, indent=2)
+    print(f"Report written to {output}")
+
+    if baseline_path:
+        with open(baseline_path, 'r') as f:
+            baseline = json.load(f)
+        if compare(baseline, report, args.threshold):
+            sys.exit(1)
+
+
+def configurations(only):
+    """The benchmark matrix as (name, arguments) pairs, the base configuration once"""
+    seen = set()
+    for parameter, values in SCALING.items():
+        if only and parameter not in only:
+            continue
+        for value in values:
+            config = dict(BASE)
+            config[parameter] = value
+            name = ' '.join(f"{key}={config[key]}" for key in sorted(config))
+            if name in seen:
+                continue
+            seen.add(name)
+            yield name, config
+
+
+def validate(program, only, tolerance, output, commit):
+    """Run the 20 MHz configurations on both PHY engines; returns the exit status"""
+    report = {
+        'date': datetime.now().isoformat(timespec='seconds'),
+        'commit': commit,
+        'tolerance': tolerance,
+        'runs': [],
+    }
+    failures = 0
+    for name, config in configurations(only):
+        if config['channelWidth'] != 20:
+            continue
+        spectrum = run(program, dict(config, phyEngine='spectrum'))
+        yans = run(program, dict(config, phyEngine='yans'))
+        difference = 0
+        if spectrum['throughput'] > 0:
+            difference = (yans['throughput'] - spectrum['throughput']) / spectrum['throughput']
+        ok = abs(difference) <= tolerance
+        failures += not ok
+        report['runs'].append({'name': name, 'config': config, 'spectrum': spectrum,
+                               'yans': yans, 'difference': difference, 'ok': ok})
+        print(f"{'OK  ' if ok else 'FAIL'} {name}: {spectrum['throughput']:.3f} -> "
+              f"{yans['throughput']:.3f} Mbps ({difference:+.1%}), wall "
+              f"{spectrum['wall']:.2f} -> {yans['wall']:.2f} s")
+
+    with open(output, 'w') as f:
+        json.dump(report, f, indent=2)
+    print(f"{failures} configuration(s) outside {tolerance:.0%}, report written to {output}")
+    return 1 if failures else 0
+
+
+def run(program, config, extra=''):
+    """Run one configuration and return the metrics of its BENCH and Throughput lines"""
+    arguments = ' '.join(f"--{key}={value}" for key, value in config.items())
+    command = ['./ns3', 'run', '--no-build', f"{program} {arguments} {extra} --bench=1"]
+    start = time.monotonic()
+    result = subprocess.run(command, stdout=subprocess.PIPE, stderr=subprocess.STDOUT,
+                            text=True)
+    wall = time.monotonic() - start
+    if result.returncode != 0:
+        print(result.stdout)
+        print(f"Error during simulation: {' '.join(command)}")
+        sys.exit(1)
+
+    metrics = None
+    throughput = 0
+    for line in result.stdout.splitlines():
+        if line.startswith('BENCH '):
+            metrics = dict(token.split('=') for token in line.split()[1:])
+        elif line.startswith('Throughput:'):
+            throughput = float(line.split(':')[1].split()[0])
+    if metrics is None:
+        print(result.stdout)
+        print("No BENCH line in the output, is --bench supported by this build?")
+        sys.exit(1)
+
+    running = float(metrics['warmup']) + float(metrics['measure'])
+    return {
+        'wall': wall,
+        'setup': float(metrics['setup']),
+        'warmup': float(metrics['warmup']),
+        'measure': float(metrics['measure']),
+        'events': int(metrics['events']),
+        'eventsPerSecond': int(metrics['events']) / running if running > 0 else 0,
+        'maxRssKb': int(metrics['maxRssKb']),
+        'throughput': throughput,
+    }
+
+
+def compare(baseline, report, threshold):
+    """Print the changes from the baseline; returns True if any is a regression"""
+    previous = {run['name']: run for run in baseline['runs']}
+    regressions = 0
+    print(f"Comparing with {baseline.get('commit', '?')} ({baseline.get('date', '?')}) "
+          f"options '{baseline.get('extra', '')}' -> '{report['extra']}'")
+    for run in report['runs']:
+        old = previous.get(run['name'])
+        if old is None:
+            print(f"  {run['name']}: not in the baseline")
+            continue
+        if old['events'] != run['events']:
+            print(f"  {run['name']}: events {old['events']} -> {run['events']} "
+                  f"(the simulated scenario changed)")
+        for metric, higher_is_better in METRICS.items():
+            if old[metric] <= 0:
+                continue
+            change = (run[metric] - old[metric]) / old[metric]
+            worse = -change if higher_is_better else change
+            if worse > threshold:
+                regressions += 1
+                print(f"  REGRESSION {run['name']}: {metric} {old[metric]:.3f} -> "
+                      f"{run[metric]:.3f} ({change:+.1%})")
+            elif -worse > threshold:
+                print(f"  improvement {run['name']}: {metric} {old[metric]:.3f} -> "
+                      f"{run[metric]:.3f} ({change:+.1%})")
+    print(f"{regressions} regression(s) above {threshold:.0%}")
+    return regressions > 0
+
+
+def git_commit():
+    result = subprocess.run(['git', 'rev-parse', 'HEAD'], stdout=subprocess.PIPE,
+                            stderr=subprocess.DEVNULL, text=True)
+    return result.stdout.strip()
+
+
+if __name__ == "__main__":
+    main()
@@ -17,6 +17,8 @@
  *
  */
 
+#include "tx-timeline-format.h"
+
 #include "ns3/ampdu-subframe-header.h"
 #include "ns3/ap-wifi-mac.h"
 #include "ns3/application-container.h"
@@ -53,6 +55,7 @@
 #include "ns3/packet-socket-helper.h"
 #include "ns3/packet-socket-server.h"
 #include "ns3/pointer.h"
+#include "ns3/propagation-loss-model.h"
 #include "ns3/qos-txop.h"
 #include "ns3/queue-item.h"
 #include "ns3/queue-size.h"
@@ -71,6 +74,8 @@
 #include "ns3/uinteger.h"
 #include "ns3/vht-configuration.h"
 #include "ns3/wifi-acknowledgment.h"
+#include "ns3/wifi-assoc-manager.h"
+#include "ns3/wifi-mac-header.h"
 #include "ns3/wifi-mac-queue.h"
 #include "ns3/wifi-net-device.h"
 #include "ns3/wifi-phy-reception-trace-helper.h"
@@ -82,32 +87,47 @@
 
 #include <algorithm>
 #include <array>
+#include <atomic>
+#include <cctype>
+#include <charconv>
+#include <chrono>
 #include <cmath>
+#include <condition_variable>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cxxabi.h>
 #include <fstream>
 #include <functional>
 #include <iomanip>
 #include <map>
+#include <memory>
+#include <mutex>
 #include <numeric>
+#include <queue>
+#include <random>
 #include <set>
 #include <sstream>
+#include <string_view>
+#include <thread>
 #include <type_traits>
+#include <typeindex>
 #include <unordered_map>
 #include <vector>
+
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
 /// Avoid std::numbers::pi because it's C++20
 #define PI 3.1415926535
 
 using namespace ns3;
 
-// Function to calculate throughput and success probability for each BSS
-void CalculateThroughputAndSuccess(int numBSS, std::vector<int> successes, int payloadSize, double simulationTime) {
-    for (int bss = 0; bss < numBSS; ++bss) {
-        double successProbability = static_cast<double>(successes[bss]) / (successes[bss] + 1e-9); // Avoid division by zero
-        double throughput = static_cast<double>(successes[bss]) * payloadSize * 8 / simulationTime; // In bits/sec
-        std::cout << "BSS " << bss + 1 << ": Throughput = " << throughput / 1e6 << " Mbps, "
-                  << "Success Probability = " << successProbability << std::endl;
-    }
-}
-
 NS_LOG_COMPONENT_DEFINE("tgax-calibration");
 
 WifiPhyReceptionTraceHelper wifiStats;
@@ -118,6 +138,9 @@ double edThreshold = -62;             ///< Energy Detect Threshold for all secon
 uint32_t seedNumber = 1;              ///< Seed number for simulation
 std::string appType("constant");      ///< Application type
 std::string propagationModel = "log"; ///< Propagation Loss Model to use
+std::string topology("disc");         ///< STA placement around each AP (disc, disc-random)
+std::string apLayout("grid");         ///< AP placement: grid, hex or poisson
+int apMeanCount = 0; ///< apLayout=poisson: mean AP count (apNodes), apNodeCount is the drawn one
 
 ///< apartments; apartment-random places nodes randomly within square
 ///< apartment; circle-random places nodes randomly within circle
@@ -140,6 +163,43 @@ uint8_t maxMpdus = 0; ///< The maximum number of MPDUs in A-MPDUs (0 to disable
 double txPower = 50;  ///< The transmit power of all the nodes in dBm
 uint16_t pktInterval = 1000;       ///< The socket packet interval in microseconds
 bool enablePhyTraceHelper = false; ///< Choose wether to use the wifi-phy PhyRxbegin trace source
+double timelineFlush = 0.1; ///< Simulated seconds between two drains of the PHY trace records
+std::string timelineFormat("csv"); ///< tx-timeline.txt (csv) or tx-timeline.bin (binary)
+double burstOn = 10;               ///< bursty: mean on period (ms)
+double burstOff = 10;              ///< bursty: mean off period (ms)
+std::string trafficTrace;          ///< bursty-trace: trace file, {sta} is replaced by the STA index
+double traceWindow = 0.1;          ///< bursty-trace: seconds of the trace scheduled at a time
+double trafficArrivalRate = 0;     ///< poisson: packets per microsecond of every STA
+std::string arrivalOutput("multi-bss.dat"); ///< poisson: per-lambda results appended here
+std::string phyTraceMode("records"); ///< records (trace helper) or aggregate (counters only)
+double phyTraceSample = 0; ///< aggregate: fraction of receptions also written to the timeline
+std::string telemetryFile;     ///< CW/backoff/queue/throughput time series (empty: off)
+double telemetryPeriod = 0.01; ///< Simulated seconds between two telemetry samples
+uint32_t telemetryCapacity = 4096; ///< Samples buffered per node before they are dropped
+std::string occupancyFile; ///< Per-node airtime and BSS overlap matrix (empty: off)
+double warmup = -1; ///< Simulated seconds before measurement starts (-1: 10 s, 0.5 s when
+                    ///< restoring a setup snapshot, 0.1 s with preassociate)
+bool preassociate = false; ///< STAs go straight to the AP of their BSS, without scanning or polling
+std::string snapshotFile("setup.snapshot"); ///< Written by app=setup, read by app=setup-done
+bool lossCache = false; ///< Answer path loss lookups from a matrix computed once placement is done
+double cullMargin = -1; ///< Skip receivers more than this many dB under the noise floor (<0: off)
+bool bench = false;     ///< Print a BENCH line (phase wall times, events, peak RSS) at the end
+std::string profileFile; ///< Per-event-type profile written at the end of the run (empty: off)
+double ciTarget = 0;   ///< Stop once every BSS throughput CI is within this relative error (0: off)
+double ciBatch = 0.1;  ///< Simulated seconds per batch of the batch means
+uint32_t replications = 1; ///< Seeds run back to back in this process (rng, rng + 1, ...)
+std::string phyEngine("spectrum"); ///< PHY and channel models: spectrum or yans (20 MHz only)
+std::string payload("socket"); ///< socket (PacketSocketClient) or virtual (VirtualPayloadClient)
+
+// Sweep mode
+std::string sweepGrid;                       ///< Parameter grid to sweep, empty runs one trial
+uint32_t sweepWorkers = 0;                   ///< Number of worker processes (0 uses all cores)
+std::string sweepStore("sweep-results.txt"); ///< Results store, one line per finished point
+std::string sweepKey;                        ///< Set on sweep workers: hash of the running point
+std::string cacheFile; ///< Result cache shared by identical runs (empty: off)
+double cacheVerify = 0; ///< Fraction of the cache hits that are simulated again and compared
+double sweepPrune = 0; ///< Simulate only points estimated within this fraction of the best (0: all)
+std::string sweepPruneBy("ccaSensitivity"); ///< Points differing only in this option are compared
 
 // Create random variable generator
 Ptr<UniformRandomVariable> randomX = CreateObject<UniformRandomVariable>();
@@ -154,296 +214,4384 @@ NodeContainer wifiNodes;
 NodeContainer apNodes;
 NodeContainer staNodes;
 
-std::map<uint32_t, std::vector<double>> nodeCw;
-std::map<uint32_t, std::vector<double>> nodeBackoff;
 std::map<uint64_t, int> dataRateToMcs;
-std::map<uint32_t, int> nodeMcs;
 
 int appTxrec = 0;
 
+/// Per-node state, kept in a dense registry indexed by node id
+struct NodeInfo
+{
+    int bss{-1};                    ///< BSS index of the node (put node in get BSS out)
+    bool isAp{false};               ///< Whether the node is an AP
+    int mcs{-1};                    ///< HE MCS the node transmits with (-1 if not constant)
+    uint32_t associatedAp{NO_NODE}; ///< STAs: node id of the AP they associated with
+    uint32_t cw{0};                 ///< Last contention window of the node
+    uint32_t backoff{0};            ///< Last backoff (slots) drawn by the node
+    Ptr<WifiNetDevice> device;      ///< The wifi device of the node
+
+    static constexpr uint32_t NO_NODE = std::numeric_limits<uint32_t>::max();
+};
+
+std::vector<NodeInfo> nodeRegistry; ///< Indexed by node id
+
 // Function object to compute the hash of a MAC address
 struct MacAddressHash
 {
     std::size_t operator()(const Mac48Address& address) const;
 };
 
-std::unordered_map<Mac48Address, uint32_t, MacAddressHash> m_staMacAddressToNodeId;
-
-uint32_t associatedStas = 0;
-uint32_t deassociatedStas = 0;
-
-std::unordered_map<uint64_t, int> bssNode; // Put node in get BSS out
+/// The 48 bit MAC address as an integer, without going through a string
+uint64_t
+MacToInteger(const Mac48Address& address)
+{
+    uint8_t buffer[6];
+    address.CopyTo(buffer);
+    uint64_t value = 0;
+    for (uint8_t byte : buffer)
+    {
+        value = (value << 8) | byte;
+    }
+    return value;
+}
 
 std::size_t
 MacAddressHash::operator()(const Mac48Address& address) const
 {
-    uint8_t buffer[6];
-    address.CopyTo(buffer);
-    std::string s(buffer, buffer + 6);
-    return std::hash<std::string>{}(s);
+    // Fibonacci hashing: the high bits of the product mix every bit of the address
+    uint64_t h = MacToInteger(address) * 0x9e3779b97f4a7c15ULL;
+    return static_cast<std::size_t>(h ^ (h >> 32));
 }
 
-uint32_t
-MacAddressToNodeId(Mac48Address address)
+/**
+ * Open addressing (linear probing) table from 64 bit keys to node ids. Sized once for the
+ * number of entries, lookups and inserts never allocate.
+ */
+class FlatIdTable
 {
-    for (uint32_t i = 0; i < apDevices.GetN(); i++)
+  public:
+    static constexpr uint32_t NOT_FOUND = std::numeric_limits<uint32_t>::max();
+
+    /// Size the table for n entries (load factor at most 1/2) and clear it
+    void Reserve(std::size_t n)
     {
-        if (apDevices.Get(i)->GetAddress() == address)
+        std::size_t capacity = 16;
+        while (capacity < 2 * n)
         {
-            return apNodes.Get(i)->GetId();
+            capacity *= 2;
         }
+        m_keys.assign(capacity, EMPTY);
+        m_values.assign(capacity, NOT_FOUND);
+        m_mask = capacity - 1;
+        m_size = 0;
     }
 
-    auto it = m_staMacAddressToNodeId.find(address);
-    if (it != m_staMacAddressToNodeId.end())
+    void Insert(uint64_t key, uint32_t value)
     {
-        return it->second;
+        NS_ABORT_MSG_IF(key == EMPTY || 2 * (m_size + 1) > m_keys.size(), "FlatIdTable is full");
+        std::size_t slot = Slot(key);
+        while (m_keys[slot] != EMPTY && m_keys[slot] != key)
+        {
+            slot = (slot + 1) & m_mask;
+        }
+        m_size += (m_keys[slot] == EMPTY);
+        m_keys[slot] = key;
+        m_values[slot] = value;
     }
 
-    NS_ABORT_MSG("Found no node having MAC address " << address);
-}
+    uint32_t Find(uint64_t key) const
+    {
+        if (m_keys.empty())
+        {
+            return NOT_FOUND;
+        }
+        for (std::size_t slot = Slot(key); m_keys[slot] != EMPTY; slot = (slot + 1) & m_mask)
+        {
+            if (m_keys[slot] == key)
+            {
+                return m_values[slot];
+            }
+        }
+        return NOT_FOUND;
+    }
 
-void
-CheckStats()
+  private:
+    static constexpr uint64_t EMPTY = std::numeric_limits<uint64_t>::max();
+
+    std::size_t Slot(uint64_t key) const
+    {
+        return static_cast<std::size_t>((key * 0x9e3779b97f4a7c15ULL) >> 32) & m_mask;
+    }
+
+    std::vector<uint64_t> m_keys;   ///< EMPTY marks a free slot
+    std::vector<uint32_t> m_values; ///< value of the key in the same slot
+    std::size_t m_mask{0};          ///< capacity - 1 (capacity is a power of two)
+    std::size_t m_size{0};          ///< number of keys stored
+};
+
+FlatIdTable macToNodeId; ///< MAC address (as integer) of every AP and STA -> node id
+
+/**
+ * Uniform grid over the node positions (x, y) for range queries. Nodes are bucketed by cell
+ * in one flat array, so a query only looks at the cells overlapping its range.
+ */
+class SpatialGrid
 {
-    wifiStats.PrintAllStatistics();
+  public:
+    /// Index the positions (indexed by node id) with square cells of the given side
+    void Build(const std::vector<Vector>& positions, double cellSize)
+    {
+        m_positions = positions;
+        m_cellSize = cellSize;
+        m_minX = m_minY = std::numeric_limits<double>::max();
+        double maxX = std::numeric_limits<double>::lowest();
+        double maxY = std::numeric_limits<double>::lowest();
+        for (const Vector& position : m_positions)
+        {
+            m_minX = std::min(m_minX, position.x);
+            m_minY = std::min(m_minY, position.y);
+            maxX = std::max(maxX, position.x);
+            maxY = std::max(maxY, position.y);
+        }
+        m_nx = m_positions.empty() ? 1 : static_cast<uint32_t>((maxX - m_minX) / m_cellSize) + 1;
+        m_ny = m_positions.empty() ? 1 : static_cast<uint32_t>((maxY - m_minY) / m_cellSize) + 1;
 
-    std::ofstream outFile("tx-timeline.txt");
-    outFile << "Start Time,End Time,Source Node,DropReason\n";
+        // Counting sort of the nodes by cell
+        m_cellStart.assign(m_nx * m_ny + 1, 0);
+        for (const Vector& position : m_positions)
+        {
+            m_cellStart[Cell(position.x, position.y) + 1]++;
+        }
+        for (std::size_t cell = 0; cell < m_nx * m_ny; cell++)
+        {
+            m_cellStart[cell + 1] += m_cellStart[cell];
+        }
+        std::vector<uint32_t> next(m_cellStart.begin(), m_cellStart.end() - 1);
+        m_nodes.resize(m_positions.size());
+        for (uint32_t nodeId = 0; nodeId < m_positions.size(); nodeId++)
+        {
+            m_nodes[next[Cell(m_positions[nodeId].x, m_positions[nodeId].y)]++] = nodeId;
+        }
+    }
 
-    for (const auto& record : wifiStats.GetPpduReceptionRecord())
+    /// Append to out the ids of the nodes within range (m) of center, in the x-y plane
+    void Query(const Vector& center, double range, std::vector<uint32_t>& out) const
     {
-        if (record.m_reason)
+        if (m_positions.empty())
         {
-            outFile << record.m_startTime.GetMilliSeconds()
-                    << "," // Convert Time to a numerical format
-                    << record.m_endTime.GetMilliSeconds()
-                    << "," // Convert Time to a numerical format
-                    << record.m_senderId << "," << record.m_reason << "\n";
+            return;
         }
-        else
+        uint32_t x0 = Clamp((center.x - range - m_minX) / m_cellSize, m_nx);
+        uint32_t x1 = Clamp((center.x + range - m_minX) / m_cellSize, m_nx);
+        uint32_t y0 = Clamp((center.y - range - m_minY) / m_cellSize, m_ny);
+        uint32_t y1 = Clamp((center.y + range - m_minY) / m_cellSize, m_ny);
+        for (uint32_t y = y0; y <= y1; y++)
         {
-            bool allSuccess = true;
-            for (const auto& status : record.m_statusPerMpdu)
+            for (uint32_t x = x0; x <= x1; x++)
             {
-                if (!status)
+                std::size_t cell = std::size_t(y) * m_nx + x;
+                for (uint32_t i = m_cellStart[cell]; i < m_cellStart[cell + 1]; i++)
                 {
-                    allSuccess = false;
+                    const Vector& position = m_positions[m_nodes[i]];
+                    double dx = position.x - center.x;
+                    double dy = position.y - center.y;
+                    if (dx * dx + dy * dy <= range * range)
+                    {
+                        out.push_back(m_nodes[i]);
+                    }
                 }
             }
-            if (allSuccess)
-            {
-                outFile << record.m_startTime.GetMilliSeconds()
-                        << "," // Convert Time to a numerical format
-                        << record.m_endTime.GetMilliSeconds()
-                        << "," // Convert Time to a numerical format
-                        << record.m_senderId << ",success\n";
-            }
-            else
-            {
-                outFile << record.m_startTime.GetMilliSeconds()
-                        << "," // Convert Time to a numerical format
-                        << record.m_endTime.GetMilliSeconds()
-                        << "," // Convert Time to a numerical format
-                        << record.m_senderId << ",PayloadDecodeError\n";
-            }
         }
     }
-    outFile.close();
-}
 
-void
-CheckAssociation()
-{
-    if (associatedStas < staNodes.GetN())
+    const Vector& GetPosition(uint32_t nodeId) const
     {
-        std::cout << "RESTARTED ASSOCIATION" << std::endl;
-        for (uint32_t i = 0; i < staNodes.GetN(); i++)
+        return m_positions[nodeId];
+    }
+
+  private:
+    static uint32_t Clamp(double cell, uint32_t n)
+    {
+        if (cell <= 0)
         {
-            Ptr<NetDevice> dev = staNodes.Get(i)->GetDevice(0);
-            Ptr<WifiNetDevice> wifi_dev = DynamicCast<WifiNetDevice>(dev);
+            return 0;
+        }
+        return cell >= n ? n - 1 : static_cast<uint32_t>(cell);
+    }
 
-            Ptr<WifiPhy> dev_phy = wifi_dev->GetPhy();
-            dev_phy->SetCcaSensitivityThreshold(-82);
-            dev_phy->SetTxPowerStart(35);
-            dev_phy->SetTxPowerEnd(35);
+    std::size_t Cell(double x, double y) const
+    {
+        return std::size_t(Clamp((y - m_minY) / m_cellSize, m_ny)) * m_nx +
+               Clamp((x - m_minX) / m_cellSize, m_nx);
+    }
 
-            Ptr<WifiMac> q_mac = wifi_dev->GetMac();
+    std::vector<Vector> m_positions;   ///< node id -> position
+    std::vector<uint32_t> m_cellStart; ///< nodes of cell c are m_nodes[m_cellStart[c]..c + 1[
+    std::vector<uint32_t> m_nodes;     ///< node ids sorted by cell
+    double m_cellSize{1};              ///< side of a cell (m)
+    double m_minX{0};                  ///< x of the first column of cells
+    double m_minY{0};                  ///< y of the first row of cells
+    uint32_t m_nx{1};                  ///< number of columns
+    uint32_t m_ny{1};                  ///< number of rows
+};
 
-            Ptr<StaWifiMac> staMac = StaticCast<StaWifiMac>(q_mac);
+SpatialGrid spatialIndex; ///< Final positions of all nodes, built before mobility is installed
 
-            if (!(staMac->IsAssociated()))
-            {
-                staMac->ScanningTimeout(std::nullopt);
-            }
-        }
-        for (uint32_t i = 0; i < apNodes.GetN(); i++)
-        {
-            Ptr<NetDevice> dev = apNodes.Get(i)->GetDevice(0);
-            Ptr<WifiNetDevice> wifi_dev = DynamicCast<WifiNetDevice>(dev);
+uint32_t associatedStas = 0;
+uint32_t deassociatedStas = 0;
+EventId checkAssociationEvent;
 
-            Ptr<WifiPhy> dev_phy = wifi_dev->GetPhy();
-            dev_phy->SetCcaSensitivityThreshold(-82);
-            dev_phy->SetTxPowerStart(35);
-            dev_phy->SetTxPowerEnd(35);
+uint32_t
+MacAddressToNodeId(Mac48Address address)
+{
+    uint32_t nodeId = macToNodeId.Find(MacToInteger(address));
+    if (nodeId != FlatIdTable::NOT_FOUND)
+    {
+        return nodeId;
+    }
+
+    NS_ABORT_MSG("Found no node having MAC address " << address);
+}
+
+/*
+ * Profiling (--profile=<file>)
+ *
+ * ProfilingScheduler wraps the scheduler set by the SchedulerType global value (MapScheduler
+ * by default). The wall time between two RemoveNext() calls is the time the simulator spent
+ * running the event removed first, and is attributed to the type of that event's EventImpl;
+ * ProfileRunEnd() credits the last event when Simulator::Run() returns. MakeEvent instantiates
+ * one type per function signature, so the demangled names tell e.g. PhyEntity,
+ * ChannelAccessManager and Txop events apart.
+ * Our own trace sinks are timed separately with ProfileScope; their time is also included in
+ * the event that called them.
+ */
+
+/// Count and cumulated wall time of one profile line
+struct ProfileEntry
+{
+    uint64_t count{0};
+    double seconds{0};
+};
+
+/// Everything --profile collects
+struct SchedulerProfile
+{
+    std::unordered_map<std::type_index, ProfileEntry> events; ///< EventImpl type -> time
+    std::map<std::string_view, ProfileEntry> callbacks;       ///< ProfileScope name -> time
+    std::vector<std::pair<uint64_t, std::size_t>> depth; ///< (time step, events in the queue)
+    const std::type_info* running{nullptr};               ///< type of the event being run
+    std::chrono::steady_clock::time_point runningSince;   ///< when it was removed
+    bool runEnded{false}; ///< Simulator::Run() returned, the remaining events are not run
+};
+
+bool profiling = false; ///< Set once the ProfilingScheduler is installed
+SchedulerProfile profile;
+
+/// Times the enclosing block as a callback of the profile; a flag test when not profiling
+class ProfileScope
+{
+  public:
+    explicit ProfileScope(std::string_view name)
+        : m_name(name)
+    {
+        if (profiling)
+        {
+            m_start = std::chrono::steady_clock::now();
         }
-        Simulator::Schedule(Seconds(1), &CheckAssociation);
     }
-    else
+
+    ~ProfileScope()
     {
-        std::cout << "associated N Sta: " << associatedStas << std::endl;
-        for (uint32_t i = 0; i < staNodes.GetN(); i++)
+        if (profiling)
         {
-            Ptr<NetDevice> dev = staNodes.Get(i)->GetDevice(0);
-            Ptr<WifiNetDevice> wifi_dev = DynamicCast<WifiNetDevice>(dev);
+            ProfileEntry& entry = profile.callbacks[m_name];
+            entry.count++;
+            entry.seconds +=
+                std::chrono::duration<double>(std::chrono::steady_clock::now() - m_start).count();
+        }
+    }
 
-            Ptr<WifiPhy> dev_phy = wifi_dev->GetPhy();
+  private:
+    std::string_view m_name;
+    std::chrono::steady_clock::time_point m_start;
+};
 
-            dev_phy->SetCcaSensitivityThreshold(ccaSensitivity);
+class ProfilingScheduler : public Scheduler
+{
+  public:
+    static TypeId GetTypeId();
+    ProfilingScheduler();
 
-            dev_phy->SetTxPowerStart(txPower);
-            dev_phy->SetTxPowerEnd(txPower);
-        }
-        for (uint32_t i = 0; i < apNodes.GetN(); i++)
-        {
-            Ptr<NetDevice> dev = apNodes.Get(i)->GetDevice(0);
-            Ptr<WifiNetDevice> wifi_dev = DynamicCast<WifiNetDevice>(dev);
+    void Insert(const Event& ev) override;
+    bool IsEmpty() const override;
+    Event PeekNext() const override;
+    Event RemoveNext() override;
+    void Remove(const Event& ev) override;
 
-            Ptr<WifiPhy> dev_phy = wifi_dev->GetPhy();
-            // if duration longer than 67.10784 will beacon
-            wifi_dev->GetMac()->SetAttribute("BeaconInterval",
-                                             TimeValue(MicroSeconds(65535 * 1024)));
+  private:
+    /// Simulated time between two queue depth samples
+    static constexpr uint64_t DEPTH_INTERVAL_NS = 1000000;
 
-            dev_phy->SetCcaSensitivityThreshold(ccaSensitivity);
+    Ptr<Scheduler> m_scheduler; ///< scheduler holding the events
+    std::size_t m_size{0};      ///< events in the queue
+    uint64_t m_nextSample{0};   ///< time step of the next sample
+};
 
-            dev_phy->SetTxPowerStart(txPower);
-            dev_phy->SetTxPowerEnd(txPower);
-        }
+/// Credit the time of the event that was running until now to its type
+void
+ProfileCreditRunning(std::chrono::steady_clock::time_point now)
+{
+    if (profile.running)
+    {
+        ProfileEntry& entry = profile.events[std::type_index(*profile.running)];
+        entry.count++;
+        entry.seconds += std::chrono::duration<double>(now - profile.runningSince).count();
+        profile.running = nullptr;
     }
 }
 
+/// Credit the last event of the run; the events Simulator::Destroy() drains are not profiled
 void
-AssociatedSta(uint16_t aid, Mac48Address addy /* addr */)
+ProfileRunEnd()
 {
-    associatedStas++;
-    std::cout << "Node " << MacAddressToNodeId(addy)
-              << " associated at T=" << Simulator::Now().GetSeconds() << std::endl;
+    ProfileCreditRunning(std::chrono::steady_clock::now());
+    profile.runEnded = true;
 }
 
-void
-DeAssociatedSta(uint16_t aid, Mac48Address /* addr */)
+NS_OBJECT_ENSURE_REGISTERED(ProfilingScheduler);
+
+TypeId
+ProfilingScheduler::GetTypeId()
 {
-    deassociatedStas++;
+    static TypeId tid = TypeId("ns3::ProfilingScheduler")
+                            .SetParent<Scheduler>()
+                            .AddConstructor<ProfilingScheduler>();
+    return tid;
 }
 
-std::string
-AddressToString(const Address& addr)
+ProfilingScheduler::ProfilingScheduler()
 {
-    std::stringstream addressStr;
-    addressStr << InetSocketAddress::ConvertFrom(addr).GetIpv4() << ":"
-               << InetSocketAddress::ConvertFrom(addr).GetPort();
-    return addressStr.str();
+    StringValue type;
+    GlobalValue::GetValueByName("SchedulerType", type);
+    NS_ABORT_MSG_IF(type.Get() == "ns3::ProfilingScheduler",
+                    "SchedulerType is the scheduler --profile wraps, it cannot be itself");
+    m_scheduler = ObjectFactory(type.Get()).Create<Scheduler>();
+    profile.runEnded = false;
 }
 
-struct Point
+void
+ProfilingScheduler::Insert(const Event& ev)
 {
-    double x;
-    double y;
-};
+    m_size++;
+    m_scheduler->Insert(ev);
+}
 
-Point
-generateRandomPointInCircle(double radius, Point origin)
+bool
+ProfilingScheduler::IsEmpty() const
 {
-    Point result;
+    return m_scheduler->IsEmpty();
+}
 
-    double randomRadius = sqrt(radius * radius * randomAngle->GetValue(0.0, 1.0));
-    while (randomRadius < 1)
+Scheduler::Event
+ProfilingScheduler::PeekNext() const
+{
+    return m_scheduler->PeekNext();
+}
+
+Scheduler::Event
+ProfilingScheduler::RemoveNext()
+{
+    auto now = std::chrono::steady_clock::now();
+    Event ev = m_scheduler->RemoveNext();
+    m_size--;
+    if (profile.runEnded)
     {
-        randomRadius = sqrt(radius * radius * randomAngle->GetValue(0.0, 1.0));
+        return ev;
     }
-    double randomAngleInRadians = 2 * M_PI * randomAngle->GetValue(0.0, 1.0);
-
-    result.x = origin.x + randomRadius * cos(randomAngleInRadians);
-    result.y = origin.y + randomRadius * sin(randomAngleInRadians);
+    ProfileCreditRunning(now);
+    profile.running = &typeid(*ev.impl);
+    profile.runningSince = now;
+    if (ev.key.m_ts >= m_nextSample)
+    {
+        profile.depth.emplace_back(ev.key.m_ts, m_size);
+        m_nextSample = ev.key.m_ts + NanoSeconds(DEPTH_INTERVAL_NS).GetTimeStep();
+    }
+    return ev;
+}
 
-    return result;
+void
+ProfilingScheduler::Remove(const Event& ev)
+{
+    m_size--;
+    m_scheduler->Remove(ev);
 }
 
-int
-main(int argc, char* argv[])
+/// Flat profile: events then callbacks by decreasing time, then the queue depth samples
+void
+WriteProfile(const std::string& path)
 {
-    int mcs = -1;
+    auto write = [](std::ofstream& out, const std::string& name, const ProfileEntry& entry) {
+        out << std::fixed << std::setprecision(6) << entry.seconds << "\t" << entry.count << "\t"
+            << std::setprecision(3) << entry.seconds * 1e6 / entry.count << "\t" << name << "\n";
+    };
+    auto bySeconds = [](const auto& a, const auto& b) {
+        return a.second.seconds > b.second.seconds;
+    };
 
-    // Disable fragmentation and RTS/CTS
-    Config::SetDefault("ns3::WifiRemoteStationManager::FragmentationThreshold",
-                       StringValue("22000"));
-    Config::SetDefault("ns3::WifiRemoteStationManager::RtsCtsThreshold", StringValue("22000"));
-    // Disable short retransmission failure (make retransmissions persistent)
-    Config::SetDefault("ns3::WifiRemoteStationManager::MaxSlrc",
-                       UintegerValue(std::numeric_limits<uint32_t>::max()));
-    Config::SetDefault("ns3::WifiRemoteStationManager::MaxSsrc",
-                       UintegerValue(std::numeric_limits<uint32_t>::max()));
-    // Set maximum queue size to the largest value and set maximum queue delay to be larger
-    // than the simulation time
-    Config::SetDefault("ns3::WifiMacQueue::MaxSize",
-                       QueueSizeValue(QueueSize(QueueSizeUnit::PACKETS,
-                                                100))); // TODO: set to a smaller value. 100?
-    Config::SetDefault("ns3::WifiMacQueue::MaxDelay", TimeValue(Seconds(20 * duration)));
+    std::ofstream out(path);
+    out << "# seconds\tcount\tus/call\tevent type\n";
+    std::vector<std::pair<std::string, ProfileEntry>> events;
+    for (const auto& [type, entry] : profile.events)
+    {
+        int status = 0;
+        char* demangled = abi::__cxa_demangle(type.name(), nullptr, nullptr, &status);
+        events.emplace_back(status == 0 ? demangled : type.name(), entry);
+        std::free(demangled);
+    }
+    std::sort(events.begin(), events.end(), bySeconds);
+    for (const auto& [name, entry] : events)
+    {
+        write(out, name, entry);
+    }
 
-    std::string topology = "disc";
+    out << "# seconds\tcount\tus/call\tcallback (included in the events above)\n";
+    std::vector<std::pair<std::string, ProfileEntry>> callbacks(profile.callbacks.begin(),
+                                                                profile.callbacks.end());
+    std::sort(callbacks.begin(), callbacks.end(), bySeconds);
+    for (const auto& [name, entry] : callbacks)
+    {
+        write(out, name, entry);
+    }
 
-    CommandLine cmd(__FILE__);
-    cmd.AddValue("pktSize", "The packet size in bytes", packetSize);
-    cmd.AddValue("ed", "edThreshold for all secondary channels", edThreshold);
-    cmd.AddValue("rng", "The seed run number", seedNumber);
-    cmd.AddValue("app",
-                 "The type of application to set. (constant,bursty,bursty-trace,setup,setup-done)",
-                 appType);
+    out << "# simulated seconds\tevents in the queue\n";
+    for (const auto& [ts, depth] : profile.depth)
+    {
+        out << TimeStep(ts).GetSeconds() << "\t" << depth << "\n";
+    }
+}
 
-    cmd.AddValue("topology", "The topology to use.", topology);
-    cmd.AddValue("prop", "The propagation loss model", propagationModel);
-    cmd.AddValue("distanceAps", "Set the size of the box in meters", distanceAps);
-    cmd.AddValue("radius", "Set the radius in meters between the AP and the STAs", radius);
-    cmd.AddValue("ccaSensitivity", "The cca sensitivity (-82dBm)", ccaSensitivity);
-    cmd.AddValue("duration", "Time duration for each trial in seconds", duration);
-    cmd.AddValue("networkSize", "Number of stations per bss", networkSize);
-    cmd.AddValue("standard", "Set the standard (11a, 11b, 11g, 11n, 11ac, 11ax)", standard);
-    cmd.AddValue("apNodes", "Number of APs", apNodeCount);
-    cmd.AddValue("phyMode", "Set the constant PHY mode string used to transmit frames", phyMode);
-    cmd.AddValue("frequency", "Set the operating frequency band in GHz: 2.4, 5 or 6", frequency);
-    cmd.AddValue("channelWidth",
-                 "Set the constant channel width in MHz (only for 11n/ac/ax)",
-                 channelWidth);
-    cmd.AddValue("gi",
-                 "Set the the guard interval in nanoseconds (800 or 400 for 11n/ac, 800 or 1600 or "
-                 "3200 for 11 ax)",
-                 gi);
-    cmd.AddValue("maxMpdus",
-                 "Set the maximum number of MPDUs in A-MPDUs (0 to disable MPDU aggregation)",
-                 maxMpdus);
-    cmd.AddValue("txPower", "Set the transmit power of all nodes in dBm", txPower);
-    cmd.AddValue("pktInterval", "Set the socket packet interval in microseconds", pktInterval);
-    cmd.AddValue("enablePhyTraceHelper", "Enable BSS Color", enablePhyTraceHelper);
+/**
+ * Writes PPDU reception records to disk from a background thread, either as CSV or in the
+ * binary layout of tx-timeline-format.h. Records are handed over through a bounded queue: if
+ * the writer falls behind, the simulation waits for it instead of buffering, so memory stays
+ * flat however long the run is.
+ */
+class TimelineWriter
+{
+  public:
+    /// Open the output file and start the writer thread
+    void Open(const std::string& path, bool binary);
+    /// Move a batch of records to the writer (the batch is left empty)
+    void Push(std::vector<TimelineRecord>& batch);
+    /// Name printed for a drop reason; must be set before records with that reason are pushed
+    void SetReasonName(uint16_t reason, const std::string& name);
+    bool HasReasonName(uint16_t reason) const;
+    /// Write what is left and stop the writer thread
+    void Close();
 
-    cmd.Parse(argc, argv);
+  private:
+    void Run();
+    void Write(const std::vector<TimelineRecord>& batch);
 
-    RngSeedManager::SetSeed(seedNumber);
-    RngSeedManager::SetRun(seedNumber);
+    static constexpr std::size_t CAPACITY = 1 << 16; ///< Max records waiting for the writer
+    static constexpr std::size_t MAX_REASONS = TIMELINE_MAX_REASONS; ///< Codes that can be named
+    static constexpr std::size_t MAX_LINE = 128; ///< Longest formatted CSV record
 
-    // Example integration within the simulation
-    std::vector<int> successes = {100, 120, 110}; // Example: Replace with actual success data for each BSS
-    int payloadSize = 1500; // Example payload size in bytes
-    double simulationTime = 10.0; // Example simulation time in seconds
-    CalculateThroughputAndSuccess(successes.size(), successes, payloadSize, simulationTime);
+    std::FILE* m_file{nullptr};
+    bool m_binary{false};                               ///< Binary records instead of CSV
+    uint64_t m_nRecords{0};                             ///< Records written so far
+    std::vector<TimelineRecord> m_queue;                ///< Records waiting for the writer thread
+    std::array<std::string, MAX_REASONS> m_reasonNames; ///< Drop reason -> name
+    std::array<char, 1 << 16> m_buffer;                 ///< Formatting buffer of the writer
+    std::mutex m_mutex;
+    std::condition_variable m_notEmpty;
+    std::condition_variable m_notFull;
+    bool m_closing{false};
+    std::thread m_thread;
+};
 
-    // If not default get value from command line "HeMcs10"
-    if ((phyMode != "OfdmRate54Mbps") && (phyMode != "auto") && (phyMode != "ideal"))
+void
+TimelineWriter::Open(const std::string& path, bool binary)
+{
+    m_file = std::fopen(path.c_str(), binary ? "wb" : "w");
+    NS_ABORT_MSG_IF(!m_file, "Cannot open " << path);
+    m_binary = binary;
+    m_nRecords = 0;
+    if (m_binary)
     {
-        mcs = std::stoi(phyMode.substr(phyMode.find("s") + 1));
+        // The record count and the reason names are filled in by Close()
+        TimelineFileHeader header = MakeTimelineHeader();
+        std::fwrite(&header, sizeof(header), 1, m_file);
     }
-
-    apNodes.Create(apNodeCount);
+    else
+    {
+        std::fputs("Start Time,End Time,Source Node,DropReason\n", m_file);
+    }
+    m_queue.reserve(CAPACITY);
+    m_closing = false;
+    m_thread = std::thread(&TimelineWriter::Run, this);
+}
+
+void
+TimelineWriter::SetReasonName(uint16_t reason, const std::string& name)
+{
+    // The writer only reads the name of a reason once a record with it has been pushed, and
+    // the push happens after this under the queue mutex
+    NS_ABORT_MSG_IF(reason >= MAX_REASONS, "Unexpected drop reason " << reason);
+    m_reasonNames[reason] = name.substr(0, MAX_LINE / 2);
+}
+
+bool
+TimelineWriter::HasReasonName(uint16_t reason) const
+{
+    return reason < MAX_REASONS && !m_reasonNames[reason].empty();
+}
+
+void
+TimelineWriter::Push(std::vector<TimelineRecord>& batch)
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_notFull.wait(lock, [&] {
+        return m_queue.empty() || m_queue.size() + batch.size() <= CAPACITY;
+    });
+    m_queue.insert(m_queue.end(), batch.begin(), batch.end());
+    lock.unlock();
+    m_notEmpty.notify_one();
+    batch.clear();
+}
+
+void
+TimelineWriter::Close()
+{
+    if (!m_thread.joinable())
+    {
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_closing = true;
+    }
+    m_notEmpty.notify_one();
+    m_thread.join();
+    if (m_binary)
+    {
+        TimelineFileHeader header = MakeTimelineHeader();
+        header.nRecords = m_nRecords;
+        for (std::size_t reason = 0; reason < MAX_REASONS; reason++)
+        {
+            std::strncpy(header.reasonNames[reason],
+                         m_reasonNames[reason].c_str(),
+                         TIMELINE_REASON_NAME - 1);
+        }
+        std::fseek(m_file, 0, SEEK_SET);
+        std::fwrite(&header, sizeof(header), 1, m_file);
+    }
+    std::fclose(m_file);
+    m_file = nullptr;
+}
+
+void
+TimelineWriter::Run()
+{
+    std::vector<TimelineRecord> batch;
+    batch.reserve(CAPACITY);
+    while (true)
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_notEmpty.wait(lock, [&] { return !m_queue.empty() || m_closing; });
+        if (m_queue.empty())
+        {
+            return;
+        }
+        batch.swap(m_queue);
+        lock.unlock();
+        m_notFull.notify_one();
+        Write(batch);
+        batch.clear();
+    }
+}
+
+void
+TimelineWriter::Write(const std::vector<TimelineRecord>& batch)
+{
+    m_nRecords += batch.size();
+    if (m_binary)
+    {
+        std::fwrite(batch.data(), sizeof(TimelineRecord), batch.size(), m_file);
+        return;
+    }
+    // Same columns as the former end of run dump: times in ms, sender, outcome
+    char* out = m_buffer.data();
+    char* end = m_buffer.data() + m_buffer.size();
+    for (const auto& record : batch)
+    {
+        if (static_cast<std::size_t>(end - out) < MAX_LINE)
+        {
+            std::fwrite(m_buffer.data(), 1, out - m_buffer.data(), m_file);
+            out = m_buffer.data();
+        }
+        out = std::to_chars(out, end, record.startNs / 1000000).ptr;
+        *out++ = ',';
+        out = std::to_chars(out, end, record.endNs / 1000000).ptr;
+        *out++ = ',';
+        out = std::to_chars(out, end, record.senderId).ptr;
+        *out++ = ',';
+        std::string_view outcome = "success";
+        if (record.reason)
+        {
+            outcome = m_reasonNames[record.reason];
+        }
+        else if (record.nFailed > 0)
+        {
+            outcome = "PayloadDecodeError";
+        }
+        out = std::copy(outcome.begin(), outcome.end(), out);
+        *out++ = '\n';
+    }
+    std::fwrite(m_buffer.data(), 1, out - m_buffer.data(), m_file);
+}
+
+TimelineWriter timelineWriter;
+
+/// Totals over every drained record, replacing the statistics of the (reset) trace helper
+struct TimelineStatistics
+{
+    uint64_t ppdus{0};           ///< PPDU receptions
+    uint64_t successfulPpdus{0}; ///< PPDUs whose MPDUs were all decoded
+    uint64_t failedPpdus{0};     ///< PPDUs with at least one MPDU that failed to decode
+    uint64_t successfulMpdus{0}; ///< MPDUs decoded
+    uint64_t failedMpdus{0};     ///< MPDUs that failed to decode
+    std::map<uint16_t, uint64_t> drops; ///< Dropped PPDUs per WifiPhyRxfailureReason
+};
+
+TimelineStatistics timelineStats;
+std::vector<TimelineRecord> timelineBatch; ///< Reused between drains
+
+bool
+InMeasurementWindow()
+{
+    Time now = Simulator::Now();
+    return now >= Seconds(warmup) && now < Seconds(warmup + duration);
+}
+
+/*
+ * Aggregated PHY reception trace (--phyTraceMode=aggregate)
+ *
+ * Instead of the trace helper, which keeps one record per PPDU and receiver until the next
+ * drain, the RxOutcome and PhyRxPpduDrop traces of every node update fixed-size counters: a
+ * dense sender x receiver matrix of PPDU, MPDU, drop and airtime counts, and SNR histograms of
+ * the decoded and failed PPDUs. The totals printed by CheckStats come from the same counters. A
+ * fraction phyTraceSample of the receptions, picked by a hash of the reception time and the
+ * receiver so that no simulation random stream is used, is also written to the timeline as
+ * full records.
+ */
+
+/// Receptions of one sender at one receiver
+struct RxPairCounters
+{
+    uint64_t ppdus{0};       ///< PPDUs received or dropped
+    uint64_t okMpdus{0};     ///< MPDUs decoded
+    uint64_t failedMpdus{0}; ///< MPDUs that failed to decode
+    uint64_t dropped{0};     ///< PPDUs dropped before the end of their payload
+    uint64_t airtimeNs{0};   ///< Duration of all those PPDUs
+};
+
+constexpr int SNR_HISTOGRAM_MIN = -10;         ///< dB; lower SNRs are counted in the first bin
+constexpr std::size_t SNR_HISTOGRAM_BINS = 71; ///< 1 dB bins; higher SNRs go to the last bin
+using SnrHistogram = std::array<uint64_t, SNR_HISTOGRAM_BINS>;
+
+/// State of the aggregating mode, sized once when the traces are connected
+struct RxAggregate
+{
+    uint32_t nNodes{0};                   ///< Rows and columns of the matrix
+    std::vector<RxPairCounters> pairs;    ///< Indexed by sender * nNodes + receiver
+    SnrHistogram okSnr{};                 ///< PPDUs whose MPDUs were all decoded, by SNR
+    SnrHistogram failedSnr{};             ///< PPDUs with at least one failed MPDU, by SNR
+    uint64_t sampleThreshold{0};          ///< Receptions whose 53 bit hash is below are recorded
+    WifiPhyBand band{WIFI_PHY_BAND_5GHZ}; ///< Band of the PHYs, for the PSDU durations
+    std::string matrixPath;               ///< Written by CheckStats
+};
+
+RxAggregate rxAggregate;
+
+/// Name the drop reason in the timeline the first time it is seen
+void
+NameTimelineReason(WifiPhyRxfailureReason reason)
+{
+    if (!timelineWriter.HasReasonName(reason))
+    {
+        std::ostringstream name;
+        name << reason;
+        timelineWriter.SetReasonName(reason, name.str());
+    }
+}
+
+/// Whether this reception is one of the sampled ones
+bool
+IsSampledReception(uint32_t receiver)
+{
+    uint64_t now = Simulator::Now().GetNanoSeconds();
+    uint64_t hash = (now ^ (uint64_t{receiver} * 0x9e3779b97f4a7c15ULL)) * 0xbf58476d1ce4e5b9ULL;
+    return (hash >> 11) < rxAggregate.sampleThreshold;
+}
+
+/// Pair counters of a PSDU received by receiver, nullptr if the sender is not a wifi node
+RxPairCounters*
+RxPair(Ptr<const WifiPsdu> psdu, uint32_t receiver)
+{
+    uint32_t sender = macToNodeId.Find(MacToInteger(psdu->GetAddr2()));
+    if (sender >= rxAggregate.nNodes || receiver >= rxAggregate.nNodes)
+    {
+        return nullptr;
+    }
+    return &rxAggregate.pairs[std::size_t{sender} * rxAggregate.nNodes + receiver];
+}
+
+void
+AggregateRxOutcome(uint32_t receiver,
+                   Ptr<const WifiPsdu> psdu,
+                   RxSignalInfo rxSignalInfo,
+                   const WifiTxVector& txVector,
+                   const std::vector<bool>& statusPerMpdu)
+{
+    ProfileScope scope("AggregateRxOutcome");
+    RxPairCounters* pair;
+    if (!InMeasurementWindow() || !(pair = RxPair(psdu, receiver)))
+    {
+        return;
+    }
+    uint16_t failed = std::count(statusPerMpdu.begin(), statusPerMpdu.end(), false);
+    uint16_t ok = statusPerMpdu.size() - failed;
+    Time txDuration = WifiPhy::CalculateTxDuration(psdu->GetSize(), txVector, rxAggregate.band);
+    pair->ppdus++;
+    pair->okMpdus += ok;
+    pair->failedMpdus += failed;
+    pair->airtimeNs += txDuration.GetNanoSeconds();
+
+    timelineStats.ppdus++;
+    timelineStats.successfulMpdus += ok;
+    timelineStats.failedMpdus += failed;
+    (failed ? timelineStats.failedPpdus : timelineStats.successfulPpdus)++;
+    double snrDb = 10 * std::log10(std::max(rxSignalInfo.snr, 1e-10));
+    auto bin = static_cast<std::size_t>(
+        std::clamp<double>(std::floor(snrDb) - SNR_HISTOGRAM_MIN, 0, SNR_HISTOGRAM_BINS - 1));
+    (failed ? rxAggregate.failedSnr : rxAggregate.okSnr)[bin]++;
+
+    if (IsSampledReception(receiver))
+    {
+        TimelineRecord out{};
+        out.startNs = (Simulator::Now() - txDuration).GetNanoSeconds();
+        out.endNs = Simulator::Now().GetNanoSeconds();
+        out.senderId = macToNodeId.Find(MacToInteger(psdu->GetAddr2()));
+        out.receiverId = receiver;
+        out.nMpdus = statusPerMpdu.size();
+        out.nFailed = failed;
+        for (std::size_t i = 0; i < statusPerMpdu.size() && i < 256; i++)
+        {
+            if (statusPerMpdu[i])
+            {
+                out.mpduStatus[i / 64] |= uint64_t{1} << (i % 64);
+            }
+        }
+        timelineBatch.push_back(out);
+    }
+}
+
+void
+AggregatePpduDrop(uint32_t receiver, Ptr<const WifiPpdu> ppdu, WifiPhyRxfailureReason reason)
+{
+    ProfileScope scope("AggregatePpduDrop");
+    RxPairCounters* pair;
+    if (!InMeasurementWindow() || !(pair = RxPair(ppdu->GetPsdu(), receiver)))
+    {
+        return;
+    }
+    pair->ppdus++;
+    pair->dropped++;
+    pair->airtimeNs += ppdu->GetTxDuration().GetNanoSeconds();
+    timelineStats.ppdus++;
+    timelineStats.drops[reason]++;
+
+    if (IsSampledReception(receiver))
+    {
+        NameTimelineReason(reason);
+        TimelineRecord out{};
+        out.startNs = (Simulator::Now() - ppdu->GetTxDuration()).GetNanoSeconds();
+        out.endNs = Simulator::Now().GetNanoSeconds();
+        out.senderId = macToNodeId.Find(MacToInteger(ppdu->GetPsdu()->GetAddr2()));
+        out.receiverId = receiver;
+        out.reason = static_cast<uint16_t>(reason);
+        timelineBatch.push_back(out);
+    }
+}
+
+/// Connect the aggregating sinks to the PHY of every node
+void
+EnableRxAggregate(const NodeContainer& nodes, const std::string& matrixPath)
+{
+    rxAggregate.nNodes = NodeList::GetNNodes();
+    rxAggregate.pairs.assign(std::size_t{rxAggregate.nNodes} * rxAggregate.nNodes,
+                             RxPairCounters());
+    rxAggregate.sampleThreshold =
+        static_cast<uint64_t>(std::clamp(phyTraceSample, 0.0, 1.0) * (uint64_t{1} << 53));
+    rxAggregate.matrixPath = matrixPath;
+    for (auto it = nodes.Begin(); it != nodes.End(); it++)
+    {
+        uint32_t nodeId = (*it)->GetId();
+        Ptr<WifiPhy> phy = DynamicCast<WifiNetDevice>((*it)->GetDevice(0))->GetPhy();
+        rxAggregate.band = phy->GetPhyBand();
+        phy->TraceConnectWithoutContext("PhyRxPpduDrop",
+                                        MakeBoundCallback(&AggregatePpduDrop, nodeId));
+        phy->GetState()->TraceConnectWithoutContext(
+            "RxOutcome",
+            MakeBoundCallback(&AggregateRxOutcome, nodeId));
+    }
+}
+
+/// Write the sender x receiver matrix (pairs that saw no PPDU are left out) and the SNR
+/// histograms
+void
+WriteRxAggregate()
+{
+    std::ofstream out(rxAggregate.matrixPath);
+    out << "Sender,Receiver,PPDUs,Decoded MPDUs,Failed MPDUs,Dropped PPDUs,Airtime (us)\n";
+    for (uint32_t sender = 0; sender < rxAggregate.nNodes; sender++)
+    {
+        for (uint32_t receiver = 0; receiver < rxAggregate.nNodes; receiver++)
+        {
+            const RxPairCounters& pair =
+                rxAggregate.pairs[std::size_t{sender} * rxAggregate.nNodes + receiver];
+            if (pair.ppdus > 0)
+            {
+                out << sender << "," << receiver << "," << pair.ppdus << "," << pair.okMpdus
+                    << "," << pair.failedMpdus << "," << pair.dropped << ","
+                    << pair.airtimeNs / 1000.0 << "\n";
+            }
+        }
+    }
+    out << "\nSNR (dB),Decoded PPDUs,Failed PPDUs\n";
+    for (std::size_t bin = 0; bin < SNR_HISTOGRAM_BINS; bin++)
+    {
+        out << SNR_HISTOGRAM_MIN + static_cast<int>(bin) << "," << rxAggregate.okSnr[bin] << ","
+            << rxAggregate.failedSnr[bin] << "\n";
+    }
+    std::cout << "Reception matrix written to " << rxAggregate.matrixPath << std::endl;
+}
+
+/// Move the records gathered by the trace helper since the last drain to the timeline writer
+/// and clear them from the helper, so it never holds more than one drain interval of records
+void
+DrainTimeline()
+{
+    ProfileScope scope("DrainTimeline");
+    for (const auto& record : wifiStats.GetPpduReceptionRecord())
+    {
+        TimelineRecord out{};
+        out.startNs = record.m_startTime.GetNanoSeconds();
+        out.endNs = record.m_endTime.GetNanoSeconds();
+        out.senderId = record.m_senderId;
+        out.receiverId = record.m_receiverId;
+        out.reason = static_cast<uint16_t>(record.m_reason);
+        timelineStats.ppdus++;
+        if (record.m_reason)
+        {
+            NameTimelineReason(record.m_reason);
+            timelineStats.drops[out.reason]++;
+        }
+        else
+        {
+            out.nMpdus = record.m_statusPerMpdu.size();
+            for (std::size_t i = 0; i < record.m_statusPerMpdu.size(); i++)
+            {
+                if (!record.m_statusPerMpdu[i])
+                {
+                    out.nFailed++;
+                }
+                else if (i < 256)
+                {
+                    out.mpduStatus[i / 64] |= uint64_t{1} << (i % 64);
+                }
+            }
+            timelineStats.successfulMpdus += out.nMpdus - out.nFailed;
+            timelineStats.failedMpdus += out.nFailed;
+            (out.nFailed ? timelineStats.failedPpdus : timelineStats.successfulPpdus)++;
+        }
+        timelineBatch.push_back(out);
+    }
+    wifiStats.Reset();
+    timelineWriter.Push(timelineBatch);
+}
+
+/// Drain periodically during the measurement window
+void
+ScheduleTimelineDrain()
+{
+    DrainTimeline();
+    if (Simulator::Now() + Seconds(timelineFlush) < Seconds(warmup + duration))
+    {
+        Simulator::Schedule(Seconds(timelineFlush), &ScheduleTimelineDrain);
+    }
+}
+
+void
+CheckStats()
+{
+    DrainTimeline();
+    timelineWriter.Close();
+
+    std::cout << "PPDU receptions: " << timelineStats.ppdus << std::endl;
+    std::cout << "Successful PPDUs: " << timelineStats.successfulPpdus << std::endl;
+    std::cout << "Failed PPDUs: " << timelineStats.failedPpdus << std::endl;
+    std::cout << "Successful MPDUs: " << timelineStats.successfulMpdus << std::endl;
+    std::cout << "Failed MPDUs: " << timelineStats.failedMpdus << std::endl;
+    std::cout << "Dropped PPDUs:" << std::endl;
+    for (const auto& [reason, count] : timelineStats.drops)
+    {
+        std::cout << "  " << static_cast<WifiPhyRxfailureReason>(reason) << ": " << count
+                  << std::endl;
+    }
+    if (!rxAggregate.matrixPath.empty())
+    {
+        WriteRxAggregate();
+    }
+}
+
+/// Uplink traffic counters of one BSS over the measurement window
+struct BssCounters
+{
+    uint64_t txMpdus{0};    ///< Data MPDUs sent by the STAs of the BSS, retransmissions included
+    uint64_t phyRxMpdus{0}; ///< Data MPDUs of the BSS decoded by its AP
+    uint64_t rxPackets{0};  ///< Packets delivered to the server of the AP
+    uint64_t rxBytes{0};    ///< Bytes delivered to the server of the AP
+};
+
+std::vector<BssCounters> bssCounters; ///< Indexed by BSS, sized once when the apps are installed
+
+/// PhyTxPsduBegin of a STA: count the data MPDUs it sends
+void
+BssPhyTx(uint32_t nodeId,
+         WifiConstPsduMap psduMap,
+         WifiTxVector /* txVector */,
+         double /* txPowerW */)
+{
+    ProfileScope scope("BssPhyTx");
+    if (!InMeasurementWindow())
+    {
+        return;
+    }
+    BssCounters& counters = bssCounters[nodeRegistry[nodeId].bss];
+    for (const auto& [staId, psdu] : psduMap)
+    {
+        for (std::size_t i = 0; i < psdu->GetNMpdus(); i++)
+        {
+            if (psdu->GetHeader(i).IsQosData())
+            {
+                counters.txMpdus++;
+            }
+        }
+    }
+}
+
+/// MonitorSnifferRx of an AP: only called for MPDUs that were decoded
+void
+BssPhyRx(uint32_t apId,
+         Ptr<const Packet> packet,
+         uint16_t /* channelFreqMhz */,
+         WifiTxVector /* txVector */,
+         MpduInfo aMpdu,
+         SignalNoiseDbm /* signalNoise */,
+         uint16_t /* staId */)
+{
+    ProfileScope scope("BssPhyRx");
+    if (!InMeasurementWindow())
+    {
+        return;
+    }
+    WifiMacHeader hdr;
+    if (aMpdu.type == NORMAL_MPDU)
+    {
+        packet->PeekHeader(hdr);
+    }
+    else
+    {
+        // S-MPDUs and A-MPDU subframes still start with their delimiter
+        Ptr<Packet> mpdu = packet->Copy();
+        AmpduSubframeHeader delimiter;
+        mpdu->RemoveHeader(delimiter);
+        mpdu->PeekHeader(hdr);
+    }
+    if (hdr.IsQosData() && macToNodeId.Find(MacToInteger(hdr.GetAddr1())) == apId)
+    {
+        bssCounters[nodeRegistry[apId].bss].phyRxMpdus++;
+    }
+}
+
+/// Rx of the PacketSocketServer of an AP
+void
+BssServerRx(uint32_t bss, Ptr<const Packet> packet, const Address& /* from */)
+{
+    ProfileScope scope("BssServerRx");
+    if (!InMeasurementWindow())
+    {
+        return;
+    }
+    bssCounters[bss].rxPackets++;
+    bssCounters[bss].rxBytes += packet->GetSize();
+}
+
+/// Protocol handler of the APs in the virtual payload mode, in place of the PacketSocketServer
+void
+BssVirtualRx(uint32_t bss,
+             Ptr<NetDevice> /* device */,
+             Ptr<const Packet> packet,
+             uint16_t /* protocol */,
+             const Address& from,
+             const Address& /* to */,
+             NetDevice::PacketType /* type */)
+{
+    BssServerRx(bss, packet, from);
+}
+
+double
+BssThroughputMbps(uint32_t bss)
+{
+    return bssCounters[bss].rxBytes * 8.0 / duration / 1e6;
+}
+
+double
+AggregateThroughputMbps()
+{
+    double throughput = 0;
+    for (uint32_t bss = 0; bss < bssCounters.size(); bss++)
+    {
+        throughput += BssThroughputMbps(bss);
+    }
+    return throughput;
+}
+
+/// Jain fairness index of the values (1 when they are all equal)
+double
+JainIndex(const std::vector<double>& values)
+{
+    double sum = 0;
+    double sumSquares = 0;
+    for (double value : values)
+    {
+        sum += value;
+        sumSquares += value * value;
+    }
+    return sumSquares > 0 ? sum * sum / (values.size() * sumSquares) : 0;
+}
+
+/// Jain fairness index of the per-BSS throughputs (1 when all BSSs get the same share)
+double
+JainFairness()
+{
+    std::vector<double> throughputs;
+    for (uint32_t bss = 0; bss < bssCounters.size(); bss++)
+    {
+        throughputs.push_back(BssThroughputMbps(bss));
+    }
+    return JainIndex(throughputs);
+}
+
+void
+PrintBssStatistics()
+{
+    for (uint32_t bss = 0; bss < bssCounters.size(); bss++)
+    {
+        const BssCounters& counters = bssCounters[bss];
+        double successRatio =
+            counters.txMpdus > 0 ? static_cast<double>(counters.phyRxMpdus) / counters.txMpdus : 0;
+        // Worded so that "Throughput" and "Fairness" only appear on the aggregate lines
+        std::cout << "BSS " << bss << ": " << BssThroughputMbps(bss) << " Mbps, attempts "
+                  << counters.txMpdus << ", successes " << counters.phyRxMpdus << " (ratio "
+                  << successRatio << "), delivered " << counters.rxPackets << std::endl;
+    }
+    std::cout << "Throughput: " << AggregateThroughputMbps() << " Mbps" << std::endl;
+    std::cout << "Fairness: " << JainFairness() << std::endl;
+}
+
+/*
+ * Early termination (--ciTarget)
+ *
+ * After warmup the measurement window is cut in batches of ciBatch seconds. Once there are
+ * CI_MIN_BATCHES batches, the 95% confidence interval of the mean batch throughput of every BSS
+ * is checked, and the run stops as soon as each half-width is below ciTarget times the mean.
+ * duration is then only an upper bound.
+ */
+
+/// Running sums of the batch throughputs of one BSS
+struct BatchMeans
+{
+    uint64_t lastBytes{0}; ///< rxBytes at the end of the previous batch
+    double sum{0};         ///< sum of the batch throughputs (Mbps)
+    double sumSquares{0};  ///< sum of their squares
+};
+
+constexpr uint32_t CI_MIN_BATCHES = 10; ///< Batches before the first check
+std::vector<BatchMeans> bssBatches;     ///< Indexed by BSS
+uint32_t nBatches = 0;
+EventId checkStatsEvent;
+
+/// 97.5% quantile of the Student t distribution with df degrees of freedom; above 30, the
+/// value of the lowest df of each range, so the intervals are never too narrow
+double
+StudentT975(uint32_t df)
+{
+    static const double table[] = {12.706, 4.303, 3.182, 2.776, 2.571, 2.447, 2.365, 2.306,
+                                   2.262,  2.228, 2.201, 2.179, 2.160, 2.145, 2.131, 2.120,
+                                   2.110,  2.101, 2.093, 2.086, 2.080, 2.074, 2.069, 2.064,
+                                   2.060,  2.056, 2.052, 2.048, 2.045, 2.042};
+    if (df <= 30)
+    {
+        return table[df - 1];
+    }
+    return df <= 40 ? 2.042 : (df <= 60 ? 2.021 : (df <= 120 ? 2.000 : 1.980));
+}
+
+void
+EndBatch()
+{
+    nBatches++;
+    double worst = 0; // largest relative half-width over the BSSs
+    for (uint32_t bss = 0; bss < bssCounters.size(); bss++)
+    {
+        BatchMeans& batch = bssBatches[bss];
+        double throughput = (bssCounters[bss].rxBytes - batch.lastBytes) * 8.0 / ciBatch / 1e6;
+        batch.lastBytes = bssCounters[bss].rxBytes;
+        batch.sum += throughput;
+        batch.sumSquares += throughput * throughput;
+        if (nBatches < CI_MIN_BATCHES)
+        {
+            continue;
+        }
+
+        double mean = batch.sum / nBatches;
+        double variance =
+            std::max(0.0, (batch.sumSquares - nBatches * mean * mean) / (nBatches - 1));
+        double halfWidth = StudentT975(nBatches - 1) * std::sqrt(variance / nBatches);
+        // A BSS that delivered nothing in any batch has converged to 0
+        worst = std::max(worst, mean > 0 ? halfWidth / mean : (halfWidth > 0 ? 1e9 : 0));
+    }
+
+    Time next = Simulator::Now() + Seconds(ciBatch);
+    if (nBatches >= CI_MIN_BATCHES && worst <= ciTarget)
+    {
+        std::cout << "CI: stopped after " << nBatches << " batches ("
+                  << nBatches * ciBatch << " s), worst relative half-width " << worst
+                  << std::endl;
+        duration = nBatches * ciBatch;
+        if (checkStatsEvent.IsRunning())
+        {
+            checkStatsEvent.Cancel();
+            CheckStats();
+        }
+        Simulator::Stop();
+    }
+    else if (next <= Seconds(warmup + duration))
+    {
+        Simulator::Schedule(Seconds(ciBatch), &EndBatch);
+    }
+    else
+    {
+        std::cout << "CI: reached the duration cap, worst relative half-width " << worst
+                  << " after " << nBatches << " batches" << std::endl;
+    }
+}
+
+/*
+ * Telemetry (--telemetry)
+ *
+ * Every telemetryPeriod of the measurement window, the contention window, last backoff and
+ * WifiMacQueue depth of every node, plus the bytes delivered so far to the BSS of every AP, are
+ * sampled into a fixed-capacity single-producer single-consumer ring per node. A background
+ * thread drains the rings into a binary file: a TelemetryFileHeader followed by
+ * TelemetrySample records in the order they were drained (sort by timeNs to get a time series;
+ * numpy dtype [('timeNs','<i8'),('nodeId','<u4'),('cw','<u4'),('backoff','<u4'),
+ * ('queuePackets','<u4'),('bssRxBytes','<u8')], offset 32). When a ring is full the sample is
+ * dropped and counted, the simulation never waits for the disk.
+ */
+
+/// One sample of one node
+struct TelemetrySample
+{
+    int64_t timeNs;        ///< Simulation time of the sample
+    uint32_t nodeId;       ///< Node id
+    uint32_t cw;           ///< Contention window of the BE queue (CwTrace)
+    uint32_t backoff;      ///< Last backoff drawn by the BE queue, in slots (BackoffTrace)
+    uint32_t queuePackets; ///< Packets in the BE WifiMacQueue
+    uint64_t bssRxBytes;   ///< APs: bytes delivered to the BSS since warmup (0 for STAs)
+};
+
+static_assert(sizeof(TelemetrySample) == 32, "TelemetrySample must stay 32 bytes");
+
+/// Telemetry file header
+struct TelemetryFileHeader
+{
+    char magic[8];       ///< "MBSSTEL1"
+    uint32_t recordSize; ///< sizeof(TelemetrySample)
+    uint32_t nNodes;     ///< Number of nodes sampled
+    uint64_t nRecords;   ///< Samples written, filled in when the run ends
+    uint64_t dropped;    ///< Samples lost to full rings, filled in when the run ends
+};
+
+static_assert(sizeof(TelemetryFileHeader) == 32, "TelemetryFileHeader must stay 32 bytes");
+
+/// Lock-free ring with one producer (the simulation) and one consumer (the flusher thread)
+template <typename T>
+class SpscRing
+{
+  public:
+    explicit SpscRing(std::size_t capacity)
+        : m_slots(capacity + 1)
+    {
+    }
+
+    /// Producer side; returns false (and drops value) when the ring is full
+    bool Push(const T& value)
+    {
+        std::size_t tail = m_tail.load(std::memory_order_relaxed);
+        std::size_t next = (tail + 1 == m_slots.size()) ? 0 : tail + 1;
+        if (next == m_head.load(std::memory_order_acquire))
+        {
+            return false;
+        }
+        m_slots[tail] = value;
+        m_tail.store(next, std::memory_order_release);
+        return true;
+    }
+
+    /// Consumer side; moves every available value to out
+    void Drain(std::vector<T>& out)
+    {
+        std::size_t head = m_head.load(std::memory_order_relaxed);
+        std::size_t tail = m_tail.load(std::memory_order_acquire);
+        while (head != tail)
+        {
+            out.push_back(m_slots[head]);
+            head = (head + 1 == m_slots.size()) ? 0 : head + 1;
+        }
+        m_head.store(head, std::memory_order_release);
+    }
+
+  private:
+    std::vector<T> m_slots;             ///< One slot more than the capacity
+    std::atomic<std::size_t> m_head{0}; ///< Next slot to read
+    std::atomic<std::size_t> m_tail{0}; ///< Next slot to write
+};
+
+/// Per-node sample rings and the thread that flushes them to the telemetry file
+class TelemetryWriter
+{
+  public:
+    /// Open the output file, create one ring of the given capacity per node and start flushing
+    void Open(const std::string& path, uint32_t nNodes, std::size_t capacity);
+    /// Queue a sample of a node (simulation thread only)
+    void Record(const TelemetrySample& sample);
+    /// Flush what is left, complete the header and stop the flusher thread
+    void Close();
+
+  private:
+    void Run();
+    void Flush(std::vector<TelemetrySample>& buffer);
+
+    std::FILE* m_file{nullptr};                                      ///< Output file
+    std::vector<std::unique_ptr<SpscRing<TelemetrySample>>> m_rings; ///< Indexed by node id
+    uint64_t m_nRecords{0};           ///< Samples written (flusher thread)
+    uint64_t m_dropped{0};            ///< Samples dropped (simulation thread)
+    std::mutex m_mutex;               ///< Protects m_closing
+    std::condition_variable m_wakeUp; ///< Signalled by Close
+    bool m_closing{false};            ///< Close was called
+    std::thread m_thread;             ///< Flusher thread
+};
+
+void
+TelemetryWriter::Open(const std::string& path, uint32_t nNodes, std::size_t capacity)
+{
+    m_file = std::fopen(path.c_str(), "wb");
+    NS_ABORT_MSG_IF(!m_file, "Cannot open " << path);
+    m_rings.clear();
+    for (uint32_t i = 0; i < nNodes; i++)
+    {
+        m_rings.push_back(std::make_unique<SpscRing<TelemetrySample>>(capacity));
+    }
+    m_nRecords = 0;
+    m_dropped = 0;
+    TelemetryFileHeader header{{'M', 'B', 'S', 'S', 'T', 'E', 'L', '1'},
+                               sizeof(TelemetrySample),
+                               nNodes,
+                               0,
+                               0};
+    std::fwrite(&header, sizeof(header), 1, m_file);
+    m_closing = false;
+    m_thread = std::thread(&TelemetryWriter::Run, this);
+}
+
+void
+TelemetryWriter::Record(const TelemetrySample& sample)
+{
+    if (!m_rings[sample.nodeId]->Push(sample))
+    {
+        m_dropped++;
+    }
+}
+
+void
+TelemetryWriter::Close()
+{
+    if (!m_thread.joinable())
+    {
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_closing = true;
+    }
+    m_wakeUp.notify_one();
+    m_thread.join();
+    TelemetryFileHeader header{{'M', 'B', 'S', 'S', 'T', 'E', 'L', '1'},
+                               sizeof(TelemetrySample),
+                               static_cast<uint32_t>(m_rings.size()),
+                               m_nRecords,
+                               m_dropped};
+    std::fseek(m_file, 0, SEEK_SET);
+    std::fwrite(&header, sizeof(header), 1, m_file);
+    std::fclose(m_file);
+    m_file = nullptr;
+    std::cout << "Telemetry: " << m_nRecords << " samples, " << m_dropped << " dropped"
+              << std::endl;
+}
+
+void
+TelemetryWriter::Run()
+{
+    std::vector<TelemetrySample> buffer;
+    while (true)
+    {
+        bool closing;
+        {
+            // Flush every 50 ms of wall time, or right away when closing
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_wakeUp.wait_for(lock, std::chrono::milliseconds(50), [&] { return m_closing; });
+            closing = m_closing;
+        }
+        Flush(buffer);
+        if (closing)
+        {
+            return;
+        }
+    }
+}
+
+void
+TelemetryWriter::Flush(std::vector<TelemetrySample>& buffer)
+{
+    buffer.clear();
+    for (auto& ring : m_rings)
+    {
+        ring->Drain(buffer);
+    }
+    if (!buffer.empty())
+    {
+        std::fwrite(buffer.data(), sizeof(TelemetrySample), buffer.size(), m_file);
+        m_nRecords += buffer.size();
+    }
+}
+
+TelemetryWriter telemetryWriter;
+
+/// CwTrace of the BE queue of a node
+void
+NodeCw(uint32_t nodeId, uint32_t cw, uint8_t /* linkId */)
+{
+    nodeRegistry[nodeId].cw = cw;
+}
+
+/// BackoffTrace of the BE queue of a node
+void
+NodeBackoff(uint32_t nodeId, uint32_t backoff, uint8_t /* linkId */)
+{
+    nodeRegistry[nodeId].backoff = backoff;
+}
+
+/// Sample every node, then again after telemetryPeriod until the end of the measurement window
+void
+SampleTelemetry()
+{
+    ProfileScope scope("SampleTelemetry");
+    int64_t now = Simulator::Now().GetNanoSeconds();
+    for (auto it = wifiNodes.Begin(); it != wifiNodes.End(); it++)
+    {
+        uint32_t nodeId = (*it)->GetId();
+        const NodeInfo& info = nodeRegistry[nodeId];
+        TelemetrySample sample{};
+        sample.timeNs = now;
+        sample.nodeId = nodeId;
+        sample.cw = info.cw;
+        sample.backoff = info.backoff;
+        sample.queuePackets =
+            info.device->GetMac()->GetQosTxop(AC_BE)->GetWifiMacQueue()->GetNPackets();
+        if (info.isAp && info.bss < static_cast<int>(bssCounters.size()))
+        {
+            sample.bssRxBytes = bssCounters[info.bss].rxBytes;
+        }
+        telemetryWriter.Record(sample);
+    }
+    if (Simulator::Now() + Seconds(telemetryPeriod) < Seconds(warmup + duration))
+    {
+        Simulator::Schedule(Seconds(telemetryPeriod), &SampleTelemetry);
+    }
+}
+
+/// Connect the CW and backoff traces of every node and start sampling at the end of warmup
+void
+EnableTelemetry(const std::string& path)
+{
+    for (auto it = wifiNodes.Begin(); it != wifiNodes.End(); it++)
+    {
+        uint32_t nodeId = (*it)->GetId();
+        Ptr<QosTxop> txop = nodeRegistry[nodeId].device->GetMac()->GetQosTxop(AC_BE);
+        txop->TraceConnectWithoutContext("CwTrace", MakeBoundCallback(&NodeCw, nodeId));
+        txop->TraceConnectWithoutContext("BackoffTrace", MakeBoundCallback(&NodeBackoff, nodeId));
+    }
+    telemetryWriter.Open(path, NodeList::GetNNodes(), telemetryCapacity);
+    Simulator::Schedule(Seconds(warmup), &SampleTelemetry);
+}
+
+/*
+ * Channel occupancy (--occupancy)
+ *
+ * The "State" trace of the WifiPhyStateHelper of every node reports each PHY state period as
+ * (start, duration, state). Idle, CCA busy, TX and RX periods are clipped to the measurement
+ * window and added to per-node totals; an RX period counts as OBSS RX when the PSDU that ended
+ * it (RxOutcome or PhyRxPpduDrop, which ns-3 fires before it logs the RX period) was sent by a
+ * node of another BSS, and as unknown RX when its BSS cannot be told. Ack, BlockAck and CTS
+ * carry no transmitter address: they belong to the BSS of their receiver. TX periods are
+ * logged when they start, hence in time order, and feed a sweep over the transmissions on air: a
+ * min-heap of the end times of the active ones (at most one per node) and the number of active
+ * transmitters per BSS. Between two consecutive start or end events the set of active BSSs is
+ * constant, and the length of that segment is added to the overlap of every pair of active
+ * BSSs. Nothing is stored per PPDU.
+ */
+
+/// Airtime of one node over the measurement window
+struct NodeOccupancy
+{
+    int64_t idleNs{0};      ///< IDLE
+    int64_t ccaBusyNs{0};   ///< CCA_BUSY
+    int64_t txNs{0};        ///< TX
+    int64_t rxNs{0};        ///< RX of a PPDU of the own BSS
+    int64_t obssRxNs{0};    ///< RX of a PPDU of another BSS
+    int64_t unknownRxNs{0}; ///< RX of a PPDU whose BSS is unknown
+    int64_t loggedNs{0};    ///< End of the last state period reported by the PHY
+    int64_t txStartNs{0};   ///< Start of the last TX period (logged when it starts)
+    int64_t txEndNs{0};     ///< End of the last TX period
+    int rxBss{-1};          ///< BSS of the sender of the PSDU that ended the current RX period
+};
+
+/// Per-node airtime and the sweep of the transmissions on air
+struct Occupancy
+{
+    std::string path;                 ///< Output file (empty: disabled)
+    int64_t startNs{0};               ///< Start of the measurement window
+    int64_t endNs{0};                 ///< End of the measurement window
+    std::vector<NodeOccupancy> nodes; ///< Indexed by node id
+    uint32_t nBss{0};                 ///< Number of BSSs
+    std::vector<uint32_t> activeTx;   ///< Transmissions on air per BSS
+    std::vector<int64_t> overlapNs;   ///< nBss x nBss, time BSS i and BSS j were both on air
+    std::vector<int64_t> intraBssNs;  ///< Per BSS, time two of its nodes were on air at once
+    int64_t anyTxNs{0};               ///< Time at least one node was on air
+    int64_t sweepNs{0};               ///< Time up to which the sweep is accounted
+    std::priority_queue<std::pair<int64_t, uint32_t>,
+                        std::vector<std::pair<int64_t, uint32_t>>,
+                        std::greater<>>
+        txEnds; ///< (end, BSS) of the transmissions on air
+};
+
+Occupancy occupancy;
+
+/// Add [from, to) clipped to the measurement window to total
+void
+AddClipped(int64_t& total, int64_t from, int64_t to)
+{
+    from = std::max(from, occupancy.startNs);
+    to = std::min(to, occupancy.endNs);
+    if (to > from)
+    {
+        total += to - from;
+    }
+}
+
+/// Account the segment [occupancy.sweepNs, to), during which the active BSSs do not change
+void
+AccountTxSegment(int64_t to)
+{
+    int64_t from = std::max(occupancy.sweepNs, occupancy.startNs);
+    occupancy.sweepNs = to;
+    to = std::min(to, occupancy.endNs);
+    if (to <= from || occupancy.txEnds.empty())
+    {
+        return;
+    }
+    int64_t length = to - from;
+    occupancy.anyTxNs += length;
+    for (uint32_t i = 0; i < occupancy.nBss; i++)
+    {
+        if (occupancy.activeTx[i] == 0)
+        {
+            continue;
+        }
+        if (occupancy.activeTx[i] > 1)
+        {
+            occupancy.intraBssNs[i] += length;
+        }
+        for (uint32_t j = 0; j < occupancy.nBss; j++)
+        {
+            if (occupancy.activeTx[j] > 0)
+            {
+                occupancy.overlapNs[i * occupancy.nBss + j] += length;
+            }
+        }
+    }
+}
+
+/// Move the sweep to time now, ending the transmissions that ended before it
+void
+AdvanceTxSweep(int64_t now)
+{
+    while (!occupancy.txEnds.empty() && occupancy.txEnds.top().first <= now)
+    {
+        auto [end, bss] = occupancy.txEnds.top();
+        AccountTxSegment(end);
+        occupancy.txEnds.pop();
+        occupancy.activeTx[bss]--;
+    }
+    AccountTxSegment(now);
+}
+
+/// BSS a PSDU was sent in: that of its transmitter, else of its receiver (Ack, BlockAck and CTS
+/// have no Addr2), -1 if neither is a node of the scenario
+int
+PsduBss(Ptr<const WifiPsdu> psdu)
+{
+    for (const Mac48Address& address : {psdu->GetAddr2(), psdu->GetAddr1()})
+    {
+        uint32_t node = macToNodeId.Find(MacToInteger(address));
+        if (node < nodeRegistry.size())
+        {
+            return nodeRegistry[node].bss;
+        }
+    }
+    return -1;
+}
+
+/// RxOutcome of a node: remember the BSS of the PSDU for the RX period logged next
+void
+OccupancyRxOutcome(uint32_t nodeId,
+                   Ptr<const WifiPsdu> psdu,
+                   RxSignalInfo /* rxSignalInfo */,
+                   const WifiTxVector& /* txVector */,
+                   const std::vector<bool>& /* statusPerMpdu */)
+{
+    occupancy.nodes[nodeId].rxBss = PsduBss(psdu);
+}
+
+/// PhyRxPpduDrop of a node: same as OccupancyRxOutcome for an aborted reception; a drop without
+/// an RX period (e.g. no preamble detected) is forgotten when the next state period is logged
+void
+OccupancyPpduDrop(uint32_t nodeId, Ptr<const WifiPpdu> ppdu, WifiPhyRxfailureReason /* reason */)
+{
+    occupancy.nodes[nodeId].rxBss = PsduBss(ppdu->GetPsdu());
+}
+
+/// State trace of the WifiPhyStateHelper of a node
+void
+OccupancyState(uint32_t nodeId, Time start, Time duration, WifiPhyState state)
+{
+    ProfileScope scope("OccupancyState");
+    NodeOccupancy& node = occupancy.nodes[nodeId];
+    int64_t from = start.GetNanoSeconds();
+    int64_t to = from + duration.GetNanoSeconds();
+    node.loggedNs = std::max(node.loggedNs, to);
+    switch (state)
+    {
+    case WifiPhyState::IDLE:
+        AddClipped(node.idleNs, from, to);
+        break;
+    case WifiPhyState::CCA_BUSY:
+        AddClipped(node.ccaBusyNs, from, to);
+        break;
+    case WifiPhyState::TX: {
+        AddClipped(node.txNs, from, to);
+        node.txStartNs = from;
+        node.txEndNs = to;
+        int bss = nodeRegistry[nodeId].bss;
+        if (bss >= 0 && static_cast<uint32_t>(bss) < occupancy.nBss)
+        {
+            AdvanceTxSweep(from);
+            occupancy.txEnds.emplace(to, bss);
+            occupancy.activeTx[bss]++;
+        }
+        break;
+    }
+    case WifiPhyState::RX:
+        if (node.rxBss < 0)
+        {
+            AddClipped(node.unknownRxNs, from, to);
+        }
+        else
+        {
+            bool obss = node.rxBss != nodeRegistry[nodeId].bss;
+            AddClipped(obss ? node.obssRxNs : node.rxNs, from, to);
+        }
+        break;
+    default:
+        break;
+    }
+    // The sender is only known for the RX period that follows the outcome
+    node.rxBss = -1;
+}
+
+/// Connect the occupancy sinks to the PHY of every node
+void
+EnableOccupancy(const NodeContainer& nodes, uint32_t nBss, const std::string& path)
+{
+    occupancy.path = path;
+    occupancy.startNs = Seconds(warmup).GetNanoSeconds();
+    occupancy.endNs = Seconds(warmup + duration).GetNanoSeconds();
+    occupancy.nodes.assign(NodeList::GetNNodes(), NodeOccupancy());
+    occupancy.nBss = nBss;
+    occupancy.activeTx.assign(nBss, 0);
+    occupancy.overlapNs.assign(std::size_t{nBss} * nBss, 0);
+    occupancy.intraBssNs.assign(nBss, 0);
+    for (auto it = nodes.Begin(); it != nodes.End(); it++)
+    {
+        uint32_t nodeId = (*it)->GetId();
+        Ptr<WifiPhy> phy = nodeRegistry[nodeId].device->GetPhy();
+        phy->TraceConnectWithoutContext("PhyRxPpduDrop",
+                                        MakeBoundCallback(&OccupancyPpduDrop, nodeId));
+        phy->GetState()->TraceConnectWithoutContext(
+            "RxOutcome",
+            MakeBoundCallback(&OccupancyRxOutcome, nodeId));
+        phy->GetState()->TraceConnectWithoutContext("State",
+                                                    MakeBoundCallback(&OccupancyState, nodeId));
+    }
+}
+
+/**
+ * Close the sweep and the per-node totals at the end of the measurement window, or when
+ * --ciTarget stopped the run early, and write them: the airtime of every node, its BSS average,
+ * and the BSS x BSS overlap matrix (the diagonal is the airtime of the BSS, with the time two of
+ * its own nodes collided in the last column).
+ * Must be called before Simulator::Destroy(), the state the PHYs are in has not been logged.
+ */
+void
+WriteOccupancy()
+{
+    int64_t stopNs = Simulator::Now().GetNanoSeconds();
+    if (stopNs < occupancy.endNs)
+    {
+        // --ciTarget stopped the run early: only the last TX period of a node, logged when it
+        // started, can reach past the stop
+        for (NodeOccupancy& node : occupancy.nodes)
+        {
+            int64_t from = std::max({node.txStartNs, stopNs, occupancy.startNs});
+            int64_t to = std::min(node.txEndNs, occupancy.endNs);
+            node.txNs -= std::max<int64_t>(to - from, 0);
+        }
+        occupancy.endNs = stopNs;
+    }
+    AdvanceTxSweep(occupancy.endNs);
+    for (auto it = wifiNodes.Begin(); it != wifiNodes.End(); it++)
+    {
+        uint32_t nodeId = (*it)->GetId();
+        NodeOccupancy& node = occupancy.nodes[nodeId];
+        Ptr<WifiPhy> phy = nodeRegistry[nodeId].device->GetPhy();
+        if (phy->IsStateRx())
+        {
+            // the PSDU being received has no outcome yet
+            AddClipped(node.unknownRxNs, node.loggedNs, occupancy.endNs);
+        }
+        else if (phy->IsStateCcaBusy())
+        {
+            AddClipped(node.ccaBusyNs, node.loggedNs, occupancy.endNs);
+        }
+        else if (phy->IsStateIdle())
+        {
+            AddClipped(node.idleNs, node.loggedNs, occupancy.endNs);
+        }
+    }
+
+    auto ms = [](int64_t ns) { return ns / 1e6; };
+    std::vector<NodeOccupancy> perBss(occupancy.nBss);
+    std::vector<uint32_t> bssNodes(occupancy.nBss, 0);
+    std::ofstream out(occupancy.path);
+    out << "Node,BSS,AP,Idle (ms),CCA busy (ms),Tx (ms),Rx (ms),OBSS Rx (ms),Unknown Rx (ms)\n";
+    for (auto it = wifiNodes.Begin(); it != wifiNodes.End(); it++)
+    {
+        uint32_t nodeId = (*it)->GetId();
+        const NodeOccupancy& node = occupancy.nodes[nodeId];
+        const NodeInfo& info = nodeRegistry[nodeId];
+        out << nodeId << "," << info.bss << "," << info.isAp << "," << ms(node.idleNs) << ","
+            << ms(node.ccaBusyNs) << "," << ms(node.txNs) << "," << ms(node.rxNs) << ","
+            << ms(node.obssRxNs) << "," << ms(node.unknownRxNs) << "\n";
+        if (info.bss >= 0 && static_cast<uint32_t>(info.bss) < occupancy.nBss)
+        {
+            NodeOccupancy& bss = perBss[info.bss];
+            bss.idleNs += node.idleNs;
+            bss.ccaBusyNs += node.ccaBusyNs;
+            bss.txNs += node.txNs;
+            bss.rxNs += node.rxNs;
+            bss.obssRxNs += node.obssRxNs;
+            bss.unknownRxNs += node.unknownRxNs;
+            bssNodes[info.bss]++;
+        }
+    }
+
+    out << "\nBSS,Nodes,Mean idle (ms),Mean CCA busy (ms),Mean Tx (ms),Mean Rx (ms),"
+           "Mean OBSS Rx (ms),Mean unknown Rx (ms)\n";
+    for (uint32_t i = 0; i < occupancy.nBss; i++)
+    {
+        double n = std::max<uint32_t>(bssNodes[i], 1);
+        const NodeOccupancy& bss = perBss[i];
+        out << i << "," << bssNodes[i] << "," << ms(bss.idleNs) / n << "," << ms(bss.ccaBusyNs) / n
+            << "," << ms(bss.txNs) / n << "," << ms(bss.rxNs) / n << "," << ms(bss.obssRxNs) / n
+            << "," << ms(bss.unknownRxNs) / n << "\n";
+    }
+
+    out << "\nOn air (ms)";
+    for (uint32_t j = 0; j < occupancy.nBss; j++)
+    {
+        out << ",BSS " << j;
+    }
+    out << ",Intra-BSS overlap\n";
+    for (uint32_t i = 0; i < occupancy.nBss; i++)
+    {
+        out << "BSS " << i;
+        for (uint32_t j = 0; j < occupancy.nBss; j++)
+        {
+            out << "," << ms(occupancy.overlapNs[i * occupancy.nBss + j]);
+        }
+        out << "," << ms(occupancy.intraBssNs[i]) << "\n";
+    }
+    out << "Any," << ms(occupancy.anyTxNs) << "\n";
+    std::cout << "Occupancy written to " << occupancy.path << std::endl;
+}
+
+/// Outcome of one replication
+struct TrialResult
+{
+    uint32_t associatedStas{0};
+    uint32_t deassociatedStas{0};
+    double measured{0};                ///< Measurement window actually simulated (s)
+    double throughput{0};              ///< Aggregate throughput (Mbps)
+    double fairness{0};                ///< Jain index of the per-BSS throughputs
+    std::vector<double> bssThroughput; ///< Mbps, empty when no traffic was installed
+};
+
+TrialResult
+CollectTrialResult()
+{
+    TrialResult result;
+    result.associatedStas = associatedStas;
+    result.deassociatedStas = deassociatedStas;
+    result.measured = duration;
+    if (!bssCounters.empty())
+    {
+        result.throughput = AggregateThroughputMbps();
+        result.fairness = JainFairness();
+        for (uint32_t bss = 0; bss < bssCounters.size(); bss++)
+        {
+            result.bssThroughput.push_back(BssThroughputMbps(bss));
+        }
+    }
+    return result;
+}
+
+/// Mean of the values and half-width of its 95% confidence interval (0 for a single value)
+std::pair<double, double>
+MeanCi(const std::vector<double>& values)
+{
+    double mean = std::accumulate(values.begin(), values.end(), 0.0) / values.size();
+    if (values.size() < 2)
+    {
+        return {mean, 0};
+    }
+    double squares = 0;
+    for (double value : values)
+    {
+        squares += (value - mean) * (value - mean);
+    }
+    double stdDev = std::sqrt(squares / (values.size() - 1));
+    return {mean, StudentT975(values.size() - 1) * stdDev / std::sqrt(values.size())};
+}
+
+/// Per-trial values of one field of the results
+template <typename F>
+std::vector<double>
+Collect(const std::vector<TrialResult>& results, F field)
+{
+    std::vector<double> values;
+    for (const TrialResult& result : results)
+    {
+        values.push_back(field(result));
+    }
+    return values;
+}
+
+void
+PrintReplicationSummary(const std::vector<TrialResult>& results)
+{
+    std::cout << "Replications: " << results.size() << std::endl;
+    for (std::size_t bss = 0; bss < results.front().bssThroughput.size(); bss++)
+    {
+        auto [mean, halfWidth] =
+            MeanCi(Collect(results, [&](const TrialResult& r) { return r.bssThroughput[bss]; }));
+        std::cout << "BSS " << bss << ": " << mean << " Mbps +- " << halfWidth << std::endl;
+    }
+    auto [throughput, throughputCi] =
+        MeanCi(Collect(results, [](const TrialResult& r) { return r.throughput; }));
+    auto [fairness, fairnessCi] =
+        MeanCi(Collect(results, [](const TrialResult& r) { return r.fairness; }));
+    std::cout << "Throughput: " << throughput << " Mbps +- " << throughputCi << " (95% CI)"
+              << std::endl;
+    std::cout << "Fairness: " << fairness << " +- " << fairnessCi << " (95% CI)" << std::endl;
+}
+
+/**
+ * Association manager that only considers the AP given by the "Bssid" attribute and ends
+ * scanning as soon as that AP is heard, instead of collecting beacons until the scanning
+ * timeout. Used to restore the associations recorded in a setup snapshot and for preassociate.
+ */
+class PinnedAssocManager : public WifiAssocManager
+{
+  public:
+    static TypeId GetTypeId();
+    void NotifyChannelSwitched(uint8_t linkId) override;
+
+  private:
+    bool CanBeInserted(const StaWifiMac::ApInfo& apInfo) const override;
+    bool CanBeReturned(const StaWifiMac::ApInfo& apInfo,
+                       std::list<StaWifiMac::ApInfo::SetupLinksInfo>& setupLinks) const override;
+    void DoStartScanning() override;
+    void EndScanning();
+
+    Mac48Address m_bssid;          ///< the only AP this STA may associate with
+    Time m_scanTimeout;            ///< time to wait for the AP before scanning again
+    mutable EventId m_endScanning; ///< event ending the current scan
+};
+
+NS_OBJECT_ENSURE_REGISTERED(PinnedAssocManager);
+
+TypeId
+PinnedAssocManager::GetTypeId()
+{
+    static TypeId tid = TypeId("ns3::PinnedAssocManager")
+                            .SetParent<WifiAssocManager>()
+                            .AddConstructor<PinnedAssocManager>()
+                            .AddAttribute("Bssid",
+                                          "The BSSID of the AP to associate with",
+                                          Mac48AddressValue(),
+                                          MakeMac48AddressAccessor(&PinnedAssocManager::m_bssid),
+                                          MakeMac48AddressChecker())
+                            .AddAttribute("ScanTimeout",
+                                          "Time to wait for the AP before scanning again",
+                                          TimeValue(MilliSeconds(120)),
+                                          MakeTimeAccessor(&PinnedAssocManager::m_scanTimeout),
+                                          MakeTimeChecker());
+    return tid;
+}
+
+void
+PinnedAssocManager::NotifyChannelSwitched(uint8_t /* linkId */)
+{
+    m_endScanning.Cancel();
+}
+
+bool
+PinnedAssocManager::CanBeInserted(const StaWifiMac::ApInfo& apInfo) const
+{
+    if (apInfo.m_bssid != m_bssid || !m_endScanning.IsRunning())
+    {
+        return false;
+    }
+    // The pinned AP was heard: end scanning right after it has been inserted
+    m_endScanning.Cancel();
+    m_endScanning = Simulator::ScheduleNow(&PinnedAssocManager::EndScanning,
+                                           const_cast<PinnedAssocManager*>(this));
+    return true;
+}
+
+bool
+PinnedAssocManager::CanBeReturned(
+    const StaWifiMac::ApInfo& /* apInfo */,
+    std::list<StaWifiMac::ApInfo::SetupLinksInfo>& /* setupLinks */) const
+{
+    return true;
+}
+
+void
+PinnedAssocManager::DoStartScanning()
+{
+    m_endScanning.Cancel();
+    m_endScanning = Simulator::Schedule(m_scanTimeout, &PinnedAssocManager::EndScanning, this);
+}
+
+void
+PinnedAssocManager::EndScanning()
+{
+    ScanningTimeout();
+}
+
+/**
+ * Uplink source of the virtual payload mode (--payload=virtual). Every Interval it hands a
+ * packet of PacketSize bytes straight to the wifi device of its node. The packet is a zero-area
+ * ns3::Packet: its payload is only a byte count, never allocated, copied or zero-filled, so the
+ * WifiMacQueue, the A-MPDU aggregation and the PHY only carry headers and sizes. Compared with
+ * PacketSocketClient, there is no socket, no per-packet address string and no copy on reception.
+ */
+class VirtualPayloadClient : public Application
+{
+  public:
+    static TypeId GetTypeId();
+    /// Send to destination over device with the given protocol number
+    void SetRemote(Ptr<NetDevice> device, const Address& destination, uint16_t protocol);
+
+  private:
+    void StartApplication() override;
+    void StopApplication() override;
+    void Send();
+
+    Ptr<NetDevice> m_device; ///< device the packets are handed to
+    Address m_destination;   ///< MAC address of the AP
+    uint16_t m_protocol{0};  ///< protocol number given to the device
+    uint32_t m_size{0};      ///< virtual payload size (bytes)
+    Time m_interval;         ///< time between two packets
+    EventId m_sendEvent;     ///< next Send
+};
+
+NS_OBJECT_ENSURE_REGISTERED(VirtualPayloadClient);
+
+TypeId
+VirtualPayloadClient::GetTypeId()
+{
+    static TypeId tid = TypeId("ns3::VirtualPayloadClient")
+                            .SetParent<Application>()
+                            .AddConstructor<VirtualPayloadClient>()
+                            .AddAttribute("PacketSize",
+                                          "Virtual payload size of the packets (bytes)",
+                                          UintegerValue(1500),
+                                          MakeUintegerAccessor(&VirtualPayloadClient::m_size),
+                                          MakeUintegerChecker<uint32_t>())
+                            .AddAttribute("Interval",
+                                          "Time between two packets",
+                                          TimeValue(MilliSeconds(1)),
+                                          MakeTimeAccessor(&VirtualPayloadClient::m_interval),
+                                          MakeTimeChecker());
+    return tid;
+}
+
+void
+VirtualPayloadClient::SetRemote(Ptr<NetDevice> device,
+                                const Address& destination,
+                                uint16_t protocol)
+{
+    m_device = device;
+    m_destination = destination;
+    m_protocol = protocol;
+}
+
+void
+VirtualPayloadClient::StartApplication()
+{
+    m_sendEvent = Simulator::ScheduleNow(&VirtualPayloadClient::Send, this);
+}
+
+void
+VirtualPayloadClient::StopApplication()
+{
+    m_sendEvent.Cancel();
+}
+
+void
+VirtualPayloadClient::Send()
+{
+    m_device->Send(Create<Packet>(m_size), m_destination, m_protocol);
+    m_sendEvent = Simulator::Schedule(m_interval, &VirtualPayloadClient::Send, this);
+}
+
+/**
+ * Bursty uplink source (--app=bursty). Alternates exponentially distributed on and off periods
+ * of mean OnTime and OffTime; during an on period it hands a packet of PacketSize bytes to the
+ * wifi device of its node every Interval, like VirtualPayloadClient. The packets reach the AP
+ * through the same protocol number as the constant sources, so the PacketSocketServer or the
+ * virtual payload handler of the AP counts them.
+ */
+class BurstyClient : public Application
+{
+  public:
+    static TypeId GetTypeId();
+    BurstyClient();
+    /// Send to destination over device with the given protocol number
+    void SetRemote(Ptr<NetDevice> device, const Address& destination, uint16_t protocol);
+    /// Use the given stream of the RNG run for the on and off periods
+    void SetStream(int64_t stream);
+
+  private:
+    void StartApplication() override;
+    void StopApplication() override;
+    void StartBurst();
+    void Send();
+
+    Ptr<NetDevice> m_device;                  ///< device the packets are handed to
+    Address m_destination;                    ///< MAC address of the AP
+    uint16_t m_protocol{0};                   ///< protocol number given to the device
+    uint32_t m_size{0};                       ///< virtual payload size (bytes)
+    Time m_interval;                          ///< time between two packets of a burst
+    Time m_onTime;                            ///< mean duration of an on period
+    Time m_offTime;                           ///< mean duration of an off period
+    Time m_burstEnd;                          ///< end of the current on period
+    Ptr<ExponentialRandomVariable> m_periods; ///< on and off period durations
+    EventId m_sendEvent;                      ///< next Send or StartBurst
+};
+
+NS_OBJECT_ENSURE_REGISTERED(BurstyClient);
+
+TypeId
+BurstyClient::GetTypeId()
+{
+    static TypeId tid = TypeId("ns3::BurstyClient")
+                            .SetParent<Application>()
+                            .AddConstructor<BurstyClient>()
+                            .AddAttribute("PacketSize",
+                                          "Virtual payload size of the packets (bytes)",
+                                          UintegerValue(1500),
+                                          MakeUintegerAccessor(&BurstyClient::m_size),
+                                          MakeUintegerChecker<uint32_t>())
+                            .AddAttribute("Interval",
+                                          "Time between two packets of a burst",
+                                          TimeValue(MilliSeconds(1)),
+                                          MakeTimeAccessor(&BurstyClient::m_interval),
+                                          MakeTimeChecker())
+                            .AddAttribute("OnTime",
+                                          "Mean duration of the on periods (exponential)",
+                                          TimeValue(MilliSeconds(10)),
+                                          MakeTimeAccessor(&BurstyClient::m_onTime),
+                                          MakeTimeChecker())
+                            .AddAttribute("OffTime",
+                                          "Mean duration of the off periods (exponential)",
+                                          TimeValue(MilliSeconds(10)),
+                                          MakeTimeAccessor(&BurstyClient::m_offTime),
+                                          MakeTimeChecker());
+    return tid;
+}
+
+BurstyClient::BurstyClient()
+    : m_periods(CreateObject<ExponentialRandomVariable>())
+{
+}
+
+void
+BurstyClient::SetRemote(Ptr<NetDevice> device, const Address& destination, uint16_t protocol)
+{
+    m_device = device;
+    m_destination = destination;
+    m_protocol = protocol;
+}
+
+void
+BurstyClient::SetStream(int64_t stream)
+{
+    m_periods->SetStream(stream);
+}
+
+void
+BurstyClient::StartApplication()
+{
+    m_sendEvent = Simulator::ScheduleNow(&BurstyClient::StartBurst, this);
+}
+
+void
+BurstyClient::StopApplication()
+{
+    m_sendEvent.Cancel();
+}
+
+void
+BurstyClient::StartBurst()
+{
+    m_burstEnd = Simulator::Now() + Seconds(m_periods->GetValue(m_onTime.GetSeconds(), 0));
+    Send();
+}
+
+void
+BurstyClient::Send()
+{
+    m_device->Send(Create<Packet>(m_size), m_destination, m_protocol);
+    if (Simulator::Now() + m_interval < m_burstEnd)
+    {
+        m_sendEvent = Simulator::Schedule(m_interval, &BurstyClient::Send, this);
+    }
+    else
+    {
+        Time off = Seconds(m_periods->GetValue(m_offTime.GetSeconds(), 0));
+        m_sendEvent = Simulator::Schedule(m_burstEnd - Simulator::Now() + off,
+                                          &BurstyClient::StartBurst,
+                                          this);
+    }
+}
+
+/**
+ * Poisson uplink source (--trafficArrivalRate). Hands a packet of PacketSize bytes to the wifi
+ * device of its node after exponentially distributed gaps of mean MeanInterval, like
+ * VirtualPayloadClient. Only the next arrival is ever scheduled, so each source holds one
+ * event whatever the rate.
+ */
+class PoissonClient : public Application
+{
+  public:
+    static TypeId GetTypeId();
+    PoissonClient();
+    /// Send to destination over device with the given protocol number
+    void SetRemote(Ptr<NetDevice> device, const Address& destination, uint16_t protocol);
+    /// Use the given stream of the RNG run for the inter-arrival times
+    void SetStream(int64_t stream);
+
+  private:
+    void StartApplication() override;
+    void StopApplication() override;
+    void ScheduleNext();
+    void Send();
+
+    Ptr<NetDevice> m_device;                  ///< device the packets are handed to
+    Address m_destination;                    ///< MAC address of the AP
+    uint16_t m_protocol{0};                   ///< protocol number given to the device
+    uint32_t m_size{0};                       ///< virtual payload size (bytes)
+    Time m_meanInterval;                      ///< mean time between two packets
+    Ptr<ExponentialRandomVariable> m_arrival; ///< inter-arrival times
+    EventId m_sendEvent;                      ///< next Send
+};
+
+NS_OBJECT_ENSURE_REGISTERED(PoissonClient);
+
+TypeId
+PoissonClient::GetTypeId()
+{
+    static TypeId tid = TypeId("ns3::PoissonClient")
+                            .SetParent<Application>()
+                            .AddConstructor<PoissonClient>()
+                            .AddAttribute("PacketSize",
+                                          "Virtual payload size of the packets (bytes)",
+                                          UintegerValue(1500),
+                                          MakeUintegerAccessor(&PoissonClient::m_size),
+                                          MakeUintegerChecker<uint32_t>())
+                            .AddAttribute("MeanInterval",
+                                          "Mean time between two packets (exponential)",
+                                          TimeValue(MilliSeconds(1)),
+                                          MakeTimeAccessor(&PoissonClient::m_meanInterval),
+                                          MakeTimeChecker());
+    return tid;
+}
+
+PoissonClient::PoissonClient()
+    : m_arrival(CreateObject<ExponentialRandomVariable>())
+{
+}
+
+void
+PoissonClient::SetRemote(Ptr<NetDevice> device, const Address& destination, uint16_t protocol)
+{
+    m_device = device;
+    m_destination = destination;
+    m_protocol = protocol;
+}
+
+void
+PoissonClient::SetStream(int64_t stream)
+{
+    m_arrival->SetStream(stream);
+}
+
+void
+PoissonClient::StartApplication()
+{
+    ScheduleNext();
+}
+
+void
+PoissonClient::StopApplication()
+{
+    m_sendEvent.Cancel();
+}
+
+void
+PoissonClient::ScheduleNext()
+{
+    Time gap = Seconds(m_arrival->GetValue(m_meanInterval.GetSeconds(), 0));
+    m_sendEvent = Simulator::Schedule(gap, &PoissonClient::Send, this);
+}
+
+void
+PoissonClient::Send()
+{
+    m_device->Send(Create<Packet>(m_size), m_destination, m_protocol);
+    ScheduleNext();
+}
+
+/**
+ * Trace replay uplink source (--app=bursty-trace). Replays a text trace of one
+ * "<time (s)> <size (bytes)>" line per packet ('#' starts a comment), times relative to the
+ * start of the application and not decreasing. The trace is memory mapped and parsed lazily:
+ * every Window, the packets of the next Window are scheduled and the pages already parsed are
+ * released, so neither the trace nor its events are ever held in memory as a whole. The source
+ * stops at the end of the trace.
+ */
+class TraceReplayClient : public Application
+{
+  public:
+    static TypeId GetTypeId();
+    ~TraceReplayClient() override;
+    /// Send to destination over device with the given protocol number
+    void SetRemote(Ptr<NetDevice> device, const Address& destination, uint16_t protocol);
+
+  private:
+    void StartApplication() override;
+    void StopApplication() override;
+    /// Parse the next packet of the trace into m_nextTime and m_nextSize; false at its end
+    bool ReadNext();
+    /// Schedule the packets of the next window and the next Refill
+    void Refill();
+    void Send(uint32_t size);
+    void Unmap();
+
+    Ptr<NetDevice> m_device;     ///< device the packets are handed to
+    Address m_destination;       ///< MAC address of the AP
+    uint16_t m_protocol{0};      ///< protocol number given to the device
+    std::string m_path;          ///< trace file
+    Time m_window;               ///< how far ahead the packets are scheduled
+    Time m_start;                ///< time 0 of the trace
+    const char* m_data{nullptr}; ///< mapping of the trace
+    std::size_t m_size{0};       ///< size of the mapping
+    std::size_t m_offset{0};     ///< first byte not parsed yet
+    std::size_t m_released{0};   ///< bytes of the mapping given back to the kernel
+    std::size_t m_line{0};       ///< line of m_offset, for error messages
+    double m_nextTime{0};        ///< time of the next packet not scheduled yet
+    uint32_t m_nextSize{0};      ///< size of that packet
+    bool m_running{false};       ///< between StartApplication and StopApplication
+    EventId m_refillEvent;       ///< next Refill
+};
+
+NS_OBJECT_ENSURE_REGISTERED(TraceReplayClient);
+
+TypeId
+TraceReplayClient::GetTypeId()
+{
+    static TypeId tid = TypeId("ns3::TraceReplayClient")
+                            .SetParent<Application>()
+                            .AddConstructor<TraceReplayClient>()
+                            .AddAttribute("TraceFile",
+                                          "Packet arrival trace to replay",
+                                          StringValue(""),
+                                          MakeStringAccessor(&TraceReplayClient::m_path),
+                                          MakeStringChecker())
+                            .AddAttribute("Window",
+                                          "How far ahead the packets of the trace are scheduled",
+                                          TimeValue(MilliSeconds(100)),
+                                          MakeTimeAccessor(&TraceReplayClient::m_window),
+                                          MakeTimeChecker());
+    return tid;
+}
+
+TraceReplayClient::~TraceReplayClient()
+{
+    Unmap();
+}
+
+void
+TraceReplayClient::SetRemote(Ptr<NetDevice> device, const Address& destination, uint16_t protocol)
+{
+    m_device = device;
+    m_destination = destination;
+    m_protocol = protocol;
+}
+
+void
+TraceReplayClient::StartApplication()
+{
+    int fd = open(m_path.c_str(), O_RDONLY);
+    NS_ABORT_MSG_IF(fd < 0, "Cannot open traffic trace " << m_path);
+    struct stat st;
+    NS_ABORT_MSG_IF(fstat(fd, &st) != 0, "Cannot stat traffic trace " << m_path);
+    m_size = st.st_size;
+    m_offset = 0;
+    m_released = 0;
+    m_line = 1;
+    if (m_size > 0)
+    {
+        void* data = mmap(nullptr, m_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        NS_ABORT_MSG_IF(data == MAP_FAILED, "Cannot map traffic trace " << m_path);
+        madvise(data, m_size, MADV_SEQUENTIAL);
+        m_data = static_cast<const char*>(data);
+    }
+    close(fd);
+    m_start = Simulator::Now();
+    m_running = true;
+    m_nextTime = 0;
+    if (ReadNext())
+    {
+        Refill();
+    }
+}
+
+void
+TraceReplayClient::StopApplication()
+{
+    m_running = false;
+    m_refillEvent.Cancel();
+    Unmap();
+}
+
+bool
+TraceReplayClient::ReadNext()
+{
+    while (m_offset < m_size)
+    {
+        const char* line = m_data + m_offset;
+        const char* end = static_cast<const char*>(std::memchr(line, '\n', m_size - m_offset));
+        end = end ? end : m_data + m_size;
+        m_offset = end - m_data + 1;
+        m_line++;
+        const char* p = line;
+        while (p < end && std::isspace(static_cast<unsigned char>(*p)))
+        {
+            p++;
+        }
+        if (p == end || *p == '#')
+        {
+            continue;
+        }
+        double time;
+        auto [afterTime, timeError] = std::from_chars(p, end, time);
+        while (afterTime < end && std::isblank(static_cast<unsigned char>(*afterTime)))
+        {
+            afterTime++;
+        }
+        uint32_t size;
+        auto [afterSize, sizeError] = std::from_chars(afterTime, end, size);
+        NS_ABORT_MSG_IF(timeError != std::errc() || sizeError != std::errc(),
+                        m_path << ":" << m_line - 1 << ": expected \"<time (s)> <size (bytes)>\"");
+        NS_ABORT_MSG_IF(time < m_nextTime,
+                        m_path << ":" << m_line - 1 << ": time goes back to " << time);
+        m_nextTime = time;
+        m_nextSize = size;
+        return true;
+    }
+    return false;
+}
+
+void
+TraceReplayClient::Refill()
+{
+    Time windowEnd = Simulator::Now() + m_window;
+    bool more = true;
+    while (more && m_start + Seconds(m_nextTime) < windowEnd)
+    {
+        Simulator::Schedule(m_start + Seconds(m_nextTime) - Simulator::Now(),
+                            &TraceReplayClient::Send,
+                            this,
+                            m_nextSize);
+        more = ReadNext();
+    }
+
+    // Give the pages parsed so far back, the mapping then never holds more than a window
+    static const std::size_t pageSize = sysconf(_SC_PAGESIZE);
+    std::size_t parsed = std::min(m_offset, m_size) / pageSize * pageSize;
+    if (parsed > m_released)
+    {
+        madvise(const_cast<char*>(m_data) + m_released, parsed - m_released, MADV_DONTNEED);
+        m_released = parsed;
+    }
+
+    if (more)
+    {
+        m_refillEvent = Simulator::Schedule(m_window, &TraceReplayClient::Refill, this);
+    }
+    else
+    {
+        Unmap();
+    }
+}
+
+void
+TraceReplayClient::Send(uint32_t size)
+{
+    if (m_running)
+    {
+        m_device->Send(Create<Packet>(size), m_destination, m_protocol);
+    }
+}
+
+void
+TraceReplayClient::Unmap()
+{
+    if (m_data)
+    {
+        munmap(const_cast<char*>(m_data), m_size);
+    }
+    m_data = nullptr;
+    m_size = 0;
+}
+
+/**
+ * Propagation loss model answering from a dense N x N matrix of the losses computed by another
+ * model. The matrix is built once the nodes are placed; when a node moves only its row and
+ * column are recomputed. Pairs with a mobility model that is not in the matrix are passed to the
+ * wrapped model. Only valid for deterministic models whose loss does not depend on the transmit
+ * power (e.g. LogDistancePropagationLossModel).
+ */
+class MatrixPropagationLossModel : public PropagationLossModel
+{
+  public:
+    static TypeId GetTypeId();
+    void SetModel(Ptr<PropagationLossModel> model);
+    /// Compute the loss of every ordered pair of nodes (the nodes must have a mobility model)
+    void Build(const NodeContainer& nodes);
+    /// Loss (dB) from the tx-th to the rx-th node of the container given to Build
+    double GetLoss(std::size_t tx, std::size_t rx) const;
+    std::size_t GetN() const;
+
+  private:
+    double DoCalcRxPower(double txPowerDbm,
+                         Ptr<MobilityModel> a,
+                         Ptr<MobilityModel> b) const override;
+    int64_t DoAssignStreams(int64_t stream) override;
+    void CourseChanged(Ptr<const MobilityModel> mobility);
+    /// Recompute the row and the column of one node
+    void ComputeLosses(std::size_t index);
+
+    Ptr<PropagationLossModel> m_model;       ///< model the losses come from
+    std::vector<Ptr<MobilityModel>> m_nodes; ///< mobility model of each row / column
+    FlatIdTable m_index;                     ///< mobility model address -> row / column
+    std::vector<double> m_loss;              ///< m_loss[tx * N + rx] in dB
+};
+
+NS_OBJECT_ENSURE_REGISTERED(MatrixPropagationLossModel);
+
+TypeId
+MatrixPropagationLossModel::GetTypeId()
+{
+    static TypeId tid = TypeId("ns3::MatrixPropagationLossModel")
+                            .SetParent<PropagationLossModel>()
+                            .AddConstructor<MatrixPropagationLossModel>();
+    return tid;
+}
+
+void
+MatrixPropagationLossModel::SetModel(Ptr<PropagationLossModel> model)
+{
+    m_model = model;
+}
+
+void
+MatrixPropagationLossModel::Build(const NodeContainer& nodes)
+{
+    std::size_t n = nodes.GetN();
+    m_nodes.resize(n);
+    m_index.Reserve(n);
+    for (std::size_t i = 0; i < n; i++)
+    {
+        m_nodes[i] = nodes.Get(i)->GetObject<MobilityModel>();
+        NS_ABORT_MSG_IF(!m_nodes[i], "Node " << nodes.Get(i)->GetId() << " has no mobility");
+        m_index.Insert(reinterpret_cast<uintptr_t>(PeekPointer(m_nodes[i])), i);
+        m_nodes[i]->TraceConnectWithoutContext(
+            "CourseChange",
+            MakeCallback(&MatrixPropagationLossModel::CourseChanged, this));
+    }
+    m_loss.assign(n * n, 0);
+    for (std::size_t i = 0; i < n; i++)
+    {
+        ComputeLosses(i);
+    }
+}
+
+double
+MatrixPropagationLossModel::GetLoss(std::size_t tx, std::size_t rx) const
+{
+    return m_loss[tx * m_nodes.size() + rx];
+}
+
+std::size_t
+MatrixPropagationLossModel::GetN() const
+{
+    return m_nodes.size();
+}
+
+void
+MatrixPropagationLossModel::ComputeLosses(std::size_t index)
+{
+    std::size_t n = m_nodes.size();
+    for (std::size_t other = 0; other < n; other++)
+    {
+        // Loss as seen with a 0 dBm transmitter
+        m_loss[index * n + other] = -m_model->CalcRxPower(0, m_nodes[index], m_nodes[other]);
+        m_loss[other * n + index] = -m_model->CalcRxPower(0, m_nodes[other], m_nodes[index]);
+    }
+}
+
+void
+MatrixPropagationLossModel::CourseChanged(Ptr<const MobilityModel> mobility)
+{
+    uint32_t index = m_index.Find(reinterpret_cast<uintptr_t>(PeekPointer(mobility)));
+    if (index != FlatIdTable::NOT_FOUND && !m_loss.empty())
+    {
+        ComputeLosses(index);
+    }
+}
+
+double
+MatrixPropagationLossModel::DoCalcRxPower(double txPowerDbm,
+                                          Ptr<MobilityModel> a,
+                                          Ptr<MobilityModel> b) const
+{
+    uint32_t tx = m_index.Find(reinterpret_cast<uintptr_t>(PeekPointer(a)));
+    uint32_t rx = m_index.Find(reinterpret_cast<uintptr_t>(PeekPointer(b)));
+    if (tx == FlatIdTable::NOT_FOUND || rx == FlatIdTable::NOT_FOUND)
+    {
+        return m_model->CalcRxPower(txPowerDbm, a, b);
+    }
+    return txPowerDbm - GetLoss(tx, rx);
+}
+
+int64_t
+MatrixPropagationLossModel::DoAssignStreams(int64_t stream)
+{
+    return m_model->AssignStreams(stream);
+}
+
+Ptr<MatrixPropagationLossModel> lossMatrix; ///< Set when --lossCache wraps the loss model
+Ptr<PropagationLossModel> channelLoss;      ///< Loss model of the channel (lossMatrix if set)
+double maxLossDb = std::numeric_limits<double>::infinity(); ///< Culling threshold of the channel
+
+/// Thermal noise over the channel plus the default WifiPhy RxNoiseFigure (7 dB)
+double
+NoiseFloorDbm()
+{
+    return -174 + 10 * std::log10(channelWidth * 1e6) + 7;
+}
+
+/// Distance at which the channel loss reaches lossDb (infinity if it never does)
+double
+RangeForLoss(double lossDb)
+{
+    Ptr<MobilityModel> a = CreateObject<ConstantPositionMobilityModel>();
+    Ptr<MobilityModel> b = CreateObject<ConstantPositionMobilityModel>();
+    auto lossAt = [&](double distance) {
+        b->SetPosition(Vector(distance, 0, 0));
+        return -channelLoss->CalcRxPower(0, a, b);
+    };
+    double low = 0;
+    double high = 1;
+    while (lossAt(high) <= lossDb)
+    {
+        if (high > 1e7)
+        {
+            return std::numeric_limits<double>::infinity();
+        }
+        low = high;
+        high *= 2;
+    }
+    // The loss grows with distance: bisect down to a centimeter
+    while (high - low > 0.01)
+    {
+        double middle = (low + high) / 2;
+        (lossAt(middle) <= lossDb ? low : high) = middle;
+    }
+    return high;
+}
+
+/**
+ * Report the culling threshold. The spectrum channel itself drops every receiver whose loss
+ * exceeds its MaxLossDb attribute, before any signal arrival is scheduled; nothing else is
+ * culled.
+ */
+void
+PrintCulling()
+{
+    std::cout << "Culling: max loss " << maxLossDb << " dB (" << RangeForLoss(maxLossDb)
+              << " m)" << std::endl;
+}
+
+/// Use this loss model for the channel, behind the loss matrix with --lossCache
+void
+SetChannelLoss(Ptr<PropagationLossModel> model)
+{
+    if (lossCache)
+    {
+        lossMatrix = CreateObject<MatrixPropagationLossModel>();
+        lossMatrix->SetModel(model);
+        model = lossMatrix;
+    }
+    channelLoss = model;
+}
+
+/*
+ * Analytical estimate (--estimate)
+ *
+ * Bianchi's DCF model, solved per station on the sensing graph of the scenario, predicts the
+ * uplink throughput of every BSS from the node positions and the channel loss model in a few
+ * milliseconds. A STA contends (collides when drawing the same slot) with the STAs it receives
+ * above ccaSensitivity. Its frames are also lost when a STA it cannot hear starts transmitting
+ * during them and the resulting SINR at its AP is below what the error model decodes. Below
+ * saturation the attempt probability is scaled by the probability that the STA has a packet
+ * queued. Simplifications: every access carries max(1, maxMpdus) MPDUs, a collision costs as
+ * much channel time as a success, capture is ignored, and beacons, management frames and AP
+ * transmissions other than the acknowledgments are ignored.
+ */
+
+std::string estimateMode("off"); ///< off, only (estimate instead of simulating) or check
+
+/// One uplink (STA -> AP) of the analytical estimate
+struct EstimateLink
+{
+    uint32_t sta{0};              ///< Node id of the STA
+    uint32_t bss{0};              ///< BSS of the STA
+    double dataTime{0};           ///< PPDU duration of one access (s)
+    double accessTime{0};         ///< Channel time of one access, acknowledgment and AIFS (s)
+    double linkSuccess{0};        ///< Probability that the PPDU survives the noise alone
+    double minSinrDb{0};          ///< Lowest SINR at the AP at which the PPDU is still decoded
+    double rxPowerDbm{0};         ///< Power of the STA at its AP
+    double offeredBps{0};         ///< Offered load (bit/s)
+    double bitsPerAccess{0};      ///< Payload bits delivered by one successful access
+    std::vector<uint32_t> sensed; ///< Links whose STA this STA senses (indices in the links)
+    std::vector<uint32_t> hidden; ///< Links this STA does not sense but that break its PPDUs
+    double tau{0};                ///< Probability to transmit in a given backoff slot
+    double attemptRate{0};        ///< Attempts per second
+    double success{0};            ///< Probability that an attempt is acknowledged
+};
+
+/// Received power of node tx at node rx through the channel loss model
+double
+RxPowerDbm(uint32_t tx, uint32_t rx)
+{
+    if (!channelLoss)
+    {
+        return txPower;
+    }
+    return channelLoss->CalcRxPower(txPower,
+                                    NodeList::GetNode(tx)->GetObject<MobilityModel>(),
+                                    NodeList::GetNode(rx)->GetObject<MobilityModel>());
+}
+
+/// Transmit vector of a data PPDU sent with the given mode
+WifiTxVector
+EstimateTxVector(WifiMode mode, bool aggregation)
+{
+    WifiTxVector txVector;
+    txVector.SetMode(mode);
+    txVector.SetPreambleType(GetPreambleForTransmission(mode.GetModulationClass()));
+    txVector.SetChannelWidth(mode.GetModulationClass() >= WIFI_MOD_CLASS_HT ? channelWidth : 20);
+    txVector.SetGuardInterval(mode.GetModulationClass() == WIFI_MOD_CLASS_HE ? gi : 800);
+    txVector.SetNss(1);
+    txVector.SetAggregation(aggregation);
+    return txVector;
+}
+
+/// Lowest SINR (dB) at which a PSDU of the given size is received with probability >= success
+double
+MinSinrDb(Ptr<ErrorRateModel> model,
+          const WifiTxVector& txVector,
+          uint32_t psduBytes,
+          double success = 0.5)
+{
+    auto decoded = [&](double sinrDb) {
+        return model->GetChunkSuccessRate(txVector.GetMode(),
+                                          txVector,
+                                          std::pow(10, sinrDb / 10),
+                                          psduBytes * 8) >= success;
+    };
+    double low = -10;
+    double high = 70;
+    // The success rate grows with the SINR: bisect down to 0.01 dB
+    while (high - low > 0.01)
+    {
+        double middle = (low + high) / 2;
+        (decoded(middle) ? high : low) = middle;
+    }
+    return high;
+}
+
+/*
+ * Automatic MCS selection (--phyMode=auto)
+ *
+ * Every STA transmits with a constant HE MCS chosen from the SNR of its uplink, computed from
+ * the static channel loss and the noise floor: the highest MCS whose data PSDU is received with
+ * a PER of at most autoTargetPer. The SNR each MCS needs comes from a table built once per
+ * process (and rebuilt only if the channel width, guard interval or PSDU size change) by
+ * bisecting the TableBasedErrorRateModel, so a trial only does one lookup per link. The AP uses
+ * the MCS of its weakest STA. The choice is set as the DataMode of the ConstantRateWifiManager
+ * of each station, there is no rate adaptation feedback loop as with IdealWifiManager.
+ */
+
+double autoTargetPer = 0.1; ///< phyMode=auto: highest PER of the chosen MCS at the link SNR
+
+/// SNR each HE MCS needs to reach the target PER with the data PSDU of the scenario
+struct McsTable
+{
+    uint16_t channelWidth{0};     ///< Channel width the table was built for (MHz)
+    uint16_t gi{0};               ///< Guard interval the table was built for (ns)
+    uint32_t psduBytes{0};        ///< Data PSDU size the table was built for
+    double targetPer{0};          ///< Target PER the table was built for
+    std::vector<double> minSnrDb; ///< Indexed by MCS
+};
+
+McsTable mcsTable; ///< Kept across trials, see GetMcsTable
+
+/// Size of the data PSDU of one uplink access, with max(1, maxMpdus) MPDUs
+uint32_t
+UplinkPsduBytes()
+{
+    uint32_t nMpdus = std::max<uint32_t>(1, maxMpdus);
+    // MPDU: payload, LLC/SNAP (8), QoS data header (26) and FCS (4); A-MPDU subframes add a
+    // delimiter (4) and are padded to 4 bytes
+    uint32_t mpduBytes = packetSize + 38;
+    return (nMpdus == 1) ? mpduBytes : nMpdus * ((mpduBytes + 4 + 3) / 4 * 4);
+}
+
+/// The SNR table of the HE MCSs for the current options, built on first use
+const McsTable&
+GetMcsTable()
+{
+    uint32_t psduBytes = UplinkPsduBytes();
+    if (mcsTable.minSnrDb.empty() || mcsTable.channelWidth != channelWidth || mcsTable.gi != gi ||
+        mcsTable.psduBytes != psduBytes || mcsTable.targetPer != autoTargetPer)
+    {
+        Ptr<ErrorRateModel> errorModel = CreateObject<TableBasedErrorRateModel>();
+        mcsTable.channelWidth = channelWidth;
+        mcsTable.gi = gi;
+        mcsTable.psduBytes = psduBytes;
+        mcsTable.targetPer = autoTargetPer;
+        mcsTable.minSnrDb.clear();
+        for (uint8_t mcs = 0; mcs < 12; mcs++)
+        {
+            WifiTxVector txVector =
+                EstimateTxVector(WifiMode("HeMcs" + std::to_string(mcs)), maxMpdus > 1);
+            mcsTable.minSnrDb.push_back(
+                MinSinrDb(errorModel, txVector, psduBytes, 1 - autoTargetPer));
+        }
+    }
+    return mcsTable;
+}
+
+/// Highest HE MCS of the table that snrDb supports (0 if none does)
+int
+SelectMcs(const McsTable& table, double snrDb)
+{
+    int best = 0;
+    for (std::size_t mcs = 0; mcs < table.minSnrDb.size(); mcs++)
+    {
+        if (table.minSnrDb[mcs] <= snrDb)
+        {
+            best = mcs;
+        }
+    }
+    return best;
+}
+
+/// Choose the MCS of every STA from the SNR at its AP, and of every AP from its STAs; needs the
+/// nodes placed, not the devices
+void
+SelectAutoMcs(const std::vector<WifiMode>& modes)
+{
+    const McsTable& table = GetMcsTable();
+    std::vector<int> apMcs(apNodes.GetN(), static_cast<int>(modes.size()) - 1);
+    std::vector<uint32_t> histogram(modes.size(), 0);
+    for (uint32_t i = 0; i < staNodes.GetN(); i++)
+    {
+        uint32_t sta = staNodes.Get(i)->GetId();
+        int bss = nodeRegistry[sta].bss;
+        double snrDb = RxPowerDbm(sta, apNodes.Get(bss)->GetId()) - NoiseFloorDbm();
+        int mcs = SelectMcs(table, snrDb);
+        nodeRegistry[sta].mcs = mcs;
+        apMcs[bss] = std::min(apMcs[bss], mcs);
+        histogram[mcs]++;
+    }
+    for (uint32_t bss = 0; bss < apNodes.GetN(); bss++)
+    {
+        nodeRegistry[apNodes.Get(bss)->GetId()].mcs = apMcs[bss];
+    }
+    for (std::size_t mcs = 0; mcs < modes.size(); mcs++)
+    {
+        dataRateToMcs[modes[mcs].GetDataRate(channelWidth, gi, 1)] = mcs;
+    }
+
+    std::cout << "Auto MCS (PER <= " << autoTargetPer << "), STAs per MCS:";
+    for (std::size_t mcs = 0; mcs < histogram.size(); mcs++)
+    {
+        if (histogram[mcs] > 0)
+        {
+            std::cout << " " << mcs << ":" << histogram[mcs];
+        }
+    }
+    std::cout << std::endl;
+}
+
+/// Set the MCS chosen by SelectAutoMcs as the DataMode of every station
+void
+ConfigureAutoMcs(const std::vector<WifiMode>& modes)
+{
+    for (auto it = devices.Begin(); it != devices.End(); it++)
+    {
+        int mcs = nodeRegistry[(*it)->GetNode()->GetId()].mcs;
+        DynamicCast<WifiNetDevice>(*it)->GetRemoteStationManager()->SetAttribute(
+            "DataMode",
+            StringValue(modes[mcs].GetUniqueName()));
+    }
+}
+
+/// Attempt probability of a saturated station whose attempts fail with probability p (Bianchi)
+double
+BianchiTau(double p, uint32_t cwMin, uint32_t stages)
+{
+    double w = cwMin + 1;
+    if (std::abs(1 - 2 * p) < 1e-9)
+    {
+        p += 1e-9; // removable singularity at p = 0.5
+    }
+    return 2 * (1 - 2 * p) / ((1 - 2 * p) * (w + 1) + p * w * (1 - std::pow(2 * p, stages)));
+}
+
+/// Default best effort EDCA and PHY timing of the configured standard and band, as the
+/// installed MACs and PHYs would have them
+struct EstimateTiming
+{
+    double slot{9e-6};                    ///< Slot time (s)
+    double sifs{16e-6};                   ///< SIFS (s)
+    uint32_t cwMin{15};                   ///< Minimum contention window
+    uint32_t cwMax{1023};                 ///< Maximum contention window
+    uint32_t aifsn{3};                    ///< AIFSN of AC_BE
+    WifiPhyBand band{WIFI_PHY_BAND_5GHZ}; ///< Band of the channel
+};
+
+/// Timing of the standard and band set in RunTrial, without installing any device
+EstimateTiming
+GetEstimateTiming()
+{
+    EstimateTiming timing;
+    if (frequency == 2.4)
+    {
+        timing.band = WIFI_PHY_BAND_2_4GHZ;
+        timing.sifs = 10e-6;
+    }
+    else if (frequency == 6)
+    {
+        timing.band = WIFI_PHY_BAND_6GHZ;
+    }
+    if (standard == "11b")
+    {
+        timing.slot = 20e-6;
+        timing.cwMin = 31;
+    }
+    return timing;
+}
+
+/// Mode the AP answers a data PPDU with: the highest mandatory rate not above the data mode
+WifiMode
+EstimateAckMode(WifiMode dataMode)
+{
+    std::vector<std::string> candidates;
+    switch (dataMode.GetModulationClass())
+    {
+    case WIFI_MOD_CLASS_DSSS:
+    case WIFI_MOD_CLASS_HR_DSSS:
+        candidates = {"DsssRate1Mbps", "DsssRate2Mbps"};
+        break;
+    case WIFI_MOD_CLASS_ERP_OFDM:
+        candidates = {"ErpOfdmRate6Mbps", "ErpOfdmRate12Mbps", "ErpOfdmRate24Mbps"};
+        break;
+    default:
+        candidates = {"OfdmRate6Mbps", "OfdmRate12Mbps", "OfdmRate24Mbps"};
+        break;
+    }
+    WifiMode ackMode(candidates.front());
+    for (const auto& candidate : candidates)
+    {
+        WifiMode mode(candidate);
+        if (mode.GetDataRate(20) <= dataMode.GetNonHtReferenceRate())
+        {
+            ackMode = mode;
+        }
+    }
+    return ackMode;
+}
+
+/// Build the uplinks of every STA and the sensing graph between them
+std::vector<EstimateLink>
+BuildEstimateLinks(double& slot, uint32_t& cwMin, uint32_t& stages)
+{
+    EstimateTiming timing = GetEstimateTiming();
+    slot = timing.slot;
+    cwMin = timing.cwMin;
+    stages = std::round(std::log2((timing.cwMax + 1.0) / (cwMin + 1)));
+    double aifs = timing.sifs + timing.aifsn * slot;
+
+    Ptr<ErrorRateModel> errorModel = CreateObject<TableBasedErrorRateModel>();
+    uint32_t nMpdus = std::max<uint32_t>(1, maxMpdus);
+    uint32_t psduBytes = UplinkPsduBytes();
+    uint32_t ackBytes = (nMpdus == 1) ? 14 : 32; // Ack or compressed BlockAck
+    double noiseW = std::pow(10, NoiseFloorDbm() / 10);
+
+    std::vector<EstimateLink> links(staNodes.GetN());
+    for (uint32_t i = 0; i < staNodes.GetN(); i++)
+    {
+        EstimateLink& link = links[i];
+        link.sta = staNodes.Get(i)->GetId();
+        link.bss = nodeRegistry[link.sta].bss;
+
+        uint32_t ap = apNodes.Get(link.bss)->GetId();
+        link.rxPowerDbm = RxPowerDbm(link.sta, ap);
+        WifiMode mode(phyMode);
+        if (phyMode == "auto")
+        {
+            mode = WifiMode("HeMcs" + std::to_string(nodeRegistry[link.sta].mcs));
+        }
+        else if (phyMode == "ideal")
+        {
+            // What the ideal manager converges to, approximated by the auto choice
+            int mcs = SelectMcs(GetMcsTable(), link.rxPowerDbm - NoiseFloorDbm());
+            mode = WifiMode("HeMcs" + std::to_string(mcs));
+        }
+        WifiTxVector txVector = EstimateTxVector(mode, nMpdus > 1);
+        WifiTxVector ackTxVector = EstimateTxVector(EstimateAckMode(mode), false);
+        link.dataTime =
+            WifiPhy::CalculateTxDuration(psduBytes, txVector, timing.band).GetSeconds();
+        link.accessTime =
+            link.dataTime + timing.sifs +
+            WifiPhy::CalculateTxDuration(ackBytes, ackTxVector, timing.band).GetSeconds() + aifs;
+        link.linkSuccess =
+            errorModel->GetChunkSuccessRate(mode,
+                                            txVector,
+                                            std::pow(10, link.rxPowerDbm / 10) / noiseW,
+                                            psduBytes * 8);
+        link.minSinrDb = MinSinrDb(errorModel, txVector, psduBytes);
+        link.offeredBps = packetSize * 8 * 1e6 / pktInterval;
+        if (appType == "bursty")
+        {
+            link.offeredBps *= burstOn / (burstOn + burstOff);
+        }
+        else if (appType == "poisson")
+        {
+            link.offeredBps = packetSize * 8 * 1e6 * trafficArrivalRate;
+        }
+        link.bitsPerAccess = nMpdus * packetSize * 8.0;
+    }
+
+    // The spatial index gives the STAs within the range at which the channel loss still lets them
+    // be sensed, or break a PPDU at the AP; the exact received powers then decide
+    auto rangeFor = [](double rxPowerDbm) {
+        return channelLoss ? RangeForLoss(txPower - rxPowerDbm)
+                           : std::numeric_limits<double>::infinity();
+    };
+    std::vector<int> linkOf(NodeList::GetNNodes(), -1);
+    for (uint32_t i = 0; i < links.size(); i++)
+    {
+        linkOf[links[i].sta] = i;
+    }
+    double senseRange = rangeFor(ccaSensitivity);
+    std::vector<uint32_t> candidates;
+    for (uint32_t i = 0; i < links.size(); i++)
+    {
+        EstimateLink& link = links[i];
+        candidates.clear();
+        spatialIndex.Query(spatialIndex.GetPosition(link.sta), senseRange, candidates);
+        for (uint32_t node : candidates)
+        {
+            int j = linkOf[node];
+            if (j >= 0 && static_cast<uint32_t>(j) != i &&
+                RxPowerDbm(links[j].sta, link.sta) >= ccaSensitivity)
+            {
+                link.sensed.push_back(j);
+            }
+        }
+        std::sort(link.sensed.begin(), link.sensed.end());
+
+        // An interferer breaks the PPDU once it adds more than toleratedW to the noise at the AP
+        uint32_t ap = apNodes.Get(link.bss)->GetId();
+        double toleratedW = std::pow(10, (link.rxPowerDbm - link.minSinrDb) / 10) - noiseW;
+        double hiddenRange = toleratedW > 0 ? rangeFor(10 * std::log10(toleratedW))
+                                            : std::numeric_limits<double>::infinity();
+        candidates.clear();
+        spatialIndex.Query(spatialIndex.GetPosition(ap), hiddenRange, candidates);
+        for (uint32_t node : candidates)
+        {
+            int j = linkOf[node];
+            if (j < 0 || static_cast<uint32_t>(j) == i ||
+                std::binary_search(link.sensed.begin(), link.sensed.end(), j))
+            {
+                continue;
+            }
+            double interferenceW = std::pow(10, RxPowerDbm(links[j].sta, ap) / 10);
+            double sinrDb = link.rxPowerDbm - 10 * std::log10(noiseW + interferenceW);
+            if (sinrDb < link.minSinrDb)
+            {
+                link.hidden.push_back(j);
+            }
+        }
+        std::sort(link.hidden.begin(), link.hidden.end());
+    }
+    return links;
+}
+
+/// Per-BSS uplink throughput (Mbps) predicted by the analytical model
+std::vector<double>
+EstimateBssThroughput()
+{
+    double slot = 9e-6;
+    uint32_t cwMin = 15;
+    uint32_t stages = 6;
+    std::vector<EstimateLink> links = BuildEstimateLinks(slot, cwMin, stages);
+
+    // Damped fixed point iteration on the attempt probabilities
+    for (uint32_t iteration = 0; iteration < 1000; iteration++)
+    {
+        double change = 0;
+        std::vector<double> tau(links.size());
+        for (uint32_t i = 0; i < links.size(); i++)
+        {
+            EstimateLink& link = links[i];
+            double idle = 1 - link.tau; // no STA of {i} + sensed transmits in a slot
+            for (uint32_t j : link.sensed)
+            {
+                idle *= 1 - links[j].tau;
+            }
+            double notHit = 1;
+            for (uint32_t j : link.hidden)
+            {
+                notHit *= std::exp(-links[j].attemptRate * (link.dataTime + links[j].dataTime));
+            }
+            double p = 1 - idle / (1 - link.tau) * notHit * link.linkSuccess;
+
+            // Mean duration of a backoff slot seen by this STA
+            double successProbability = 0;
+            double successTime = 0;
+            double meanAccessTime = link.accessTime;
+            auto addSender = [&](const EstimateLink& sender) {
+                double alone = sender.tau / (1 - sender.tau) * idle;
+                successProbability += alone;
+                successTime += alone * sender.accessTime;
+            };
+            addSender(link);
+            for (uint32_t j : link.sensed)
+            {
+                addSender(links[j]);
+                meanAccessTime += links[j].accessTime;
+            }
+            meanAccessTime /= link.sensed.size() + 1;
+            double slotTime = idle * slot + successTime +
+                              std::max(0.0, 1 - idle - successProbability) * meanAccessTime;
+
+            double saturatedTau = BianchiTau(p, cwMin, stages);
+            double saturatedBps = saturatedTau / slotTime * (1 - p) * link.bitsPerAccess;
+            double busy = saturatedBps > 0 ? std::min(1.0, link.offeredBps / saturatedBps) : 1;
+            tau[i] = 0.5 * link.tau + 0.5 * busy * saturatedTau;
+            change = std::max(change, std::abs(tau[i] - link.tau));
+            link.attemptRate = tau[i] / slotTime;
+            link.success = 1 - p;
+        }
+        for (uint32_t i = 0; i < links.size(); i++)
+        {
+            links[i].tau = tau[i];
+        }
+        if (change < 1e-9)
+        {
+            break;
+        }
+    }
+
+    std::vector<double> bssThroughput(apNodeCount, 0);
+    for (const EstimateLink& link : links)
+    {
+        bssThroughput[link.bss] +=
+            std::min(link.offeredBps, link.attemptRate * link.success * link.bitsPerAccess) / 1e6;
+    }
+    return bssThroughput;
+}
+
+/// Print the estimate, next to the simulated throughputs when there are some
+void
+PrintEstimate(const std::vector<double>& estimate, const std::vector<double>& simulated)
+{
+    for (uint32_t bss = 0; bss < estimate.size(); bss++)
+    {
+        std::cout << "Estimate BSS " << bss << ": " << estimate[bss] << " Mbps";
+        if (bss < simulated.size() && simulated[bss] > 0)
+        {
+            std::cout << " (simulated " << simulated[bss] << ", "
+                      << std::showpos << 100 * (estimate[bss] / simulated[bss] - 1)
+                      << std::noshowpos << "%)";
+        }
+        std::cout << std::endl;
+    }
+    std::cout << "Estimated throughput: "
+              << std::accumulate(estimate.begin(), estimate.end(), 0.0) << " Mbps, fairness "
+              << JainIndex(estimate) << std::endl;
+}
+
+/// Options that shape the topology; a snapshot can only be restored if they are unchanged
+std::string
+SnapshotFingerprint()
+{
+    std::ostringstream config;
+    config << "apNodes=" << apNodeCount << " networkSize=" << networkSize
+           << " topology=" << topology << " apLayout=" << apLayout
+           << " distanceAps=" << +distanceAps << " radius=" << radius << " rng=" << seedNumber
+           << " standard=" << standard << " frequency=" << frequency
+           << " channelWidth=" << channelWidth;
+    return config.str();
+}
+
+/// Save node positions and STA associations once every STA is associated (app=setup)
+void
+SaveSnapshot()
+{
+    std::ofstream out(snapshotFile);
+    out << "config " << SnapshotFingerprint() << "\n";
+    out << std::setprecision(17);
+    for (uint32_t i = 0; i < wifiNodes.GetN(); i++)
+    {
+        Ptr<Node> node = wifiNodes.Get(i);
+        Vector pos = node->GetObject<MobilityModel>()->GetPosition();
+        out << "node " << node->GetId() << " " << pos.x << " " << pos.y << " " << pos.z << "\n";
+    }
+    for (uint32_t i = 0; i < staNodes.GetN(); i++)
+    {
+        uint32_t sta = staNodes.Get(i)->GetId();
+        out << "assoc " << sta << " " << nodeRegistry[sta].associatedAp << "\n";
+    }
+    out.close();
+    std::cout << "Saved setup snapshot to " << snapshotFile << " at T="
+              << Simulator::Now().GetSeconds() << std::endl;
+}
+
+/// Node positions and STA associations read back from a snapshot (app=setup-done)
+struct TopologySnapshot
+{
+    std::map<uint32_t, Vector> positions; ///< node id -> position
+    std::map<uint32_t, uint32_t> staAp;   ///< STA node id -> node id of its AP
+};
+
+TopologySnapshot
+LoadSnapshot()
+{
+    std::ifstream in(snapshotFile);
+    NS_ABORT_MSG_IF(!in, "Cannot read setup snapshot " << snapshotFile << ", run app=setup first");
+    TopologySnapshot snapshot;
+    std::string line;
+    while (std::getline(in, line))
+    {
+        std::istringstream fields(line);
+        std::string kind;
+        fields >> kind;
+        if (kind == "config")
+        {
+            std::string config = line.substr(kind.size() + 1);
+            NS_ABORT_MSG_IF(config != SnapshotFingerprint(),
+                            "Snapshot " << snapshotFile << " was taken with \"" << config
+                                        << "\" but this run uses \""
+                                        << SnapshotFingerprint() << "\"");
+        }
+        else if (kind == "node")
+        {
+            uint32_t id;
+            Vector pos;
+            fields >> id >> pos.x >> pos.y >> pos.z;
+            snapshot.positions[id] = pos;
+        }
+        else if (kind == "assoc")
+        {
+            uint32_t sta;
+            uint32_t ap;
+            fields >> sta >> ap;
+            snapshot.staAp[sta] = ap;
+        }
+    }
+    NS_ABORT_MSG_IF(snapshot.positions.size() != apNodes.GetN() + staNodes.GetN() ||
+                        snapshot.staAp.size() != staNodes.GetN(),
+                    "Incomplete setup snapshot " << snapshotFile);
+    return snapshot;
+}
+
+/// Switch from the association settings to the measured ones: CCA sensitivity, transmit power
+/// and a beacon interval longer than the run
+void
+ApplyMeasurementSettings()
+{
+    for (uint32_t i = 0; i < staNodes.GetN(); i++)
+    {
+        Ptr<NetDevice> dev = staNodes.Get(i)->GetDevice(0);
+        Ptr<WifiNetDevice> wifi_dev = DynamicCast<WifiNetDevice>(dev);
+
+        Ptr<WifiPhy> dev_phy = wifi_dev->GetPhy();
+
+        dev_phy->SetCcaSensitivityThreshold(ccaSensitivity);
+
+        dev_phy->SetTxPowerStart(txPower);
+        dev_phy->SetTxPowerEnd(txPower);
+    }
+    for (uint32_t i = 0; i < apNodes.GetN(); i++)
+    {
+        Ptr<NetDevice> dev = apNodes.Get(i)->GetDevice(0);
+        Ptr<WifiNetDevice> wifi_dev = DynamicCast<WifiNetDevice>(dev);
+
+        Ptr<WifiPhy> dev_phy = wifi_dev->GetPhy();
+        // if duration longer than 67.10784 will beacon
+        wifi_dev->GetMac()->SetAttribute("BeaconInterval",
+                                         TimeValue(MicroSeconds(65535 * 1024)));
+
+        dev_phy->SetCcaSensitivityThreshold(ccaSensitivity);
+
+        dev_phy->SetTxPowerStart(txPower);
+        dev_phy->SetTxPowerEnd(txPower);
+    }
+}
+
+void
+CheckAssociation()
+{
+    ProfileScope scope("CheckAssociation");
+    if (associatedStas < staNodes.GetN())
+    {
+        std::cout << "RESTARTED ASSOCIATION" << std::endl;
+        for (uint32_t i = 0; i < staNodes.GetN(); i++)
+        {
+            Ptr<NetDevice> dev = staNodes.Get(i)->GetDevice(0);
+            Ptr<WifiNetDevice> wifi_dev = DynamicCast<WifiNetDevice>(dev);
+
+            Ptr<WifiPhy> dev_phy = wifi_dev->GetPhy();
+            dev_phy->SetCcaSensitivityThreshold(-82);
+            dev_phy->SetTxPowerStart(35);
+            dev_phy->SetTxPowerEnd(35);
+
+            Ptr<WifiMac> q_mac = wifi_dev->GetMac();
+
+            Ptr<StaWifiMac> staMac = StaticCast<StaWifiMac>(q_mac);
+
+            if (!(staMac->IsAssociated()))
+            {
+                staMac->ScanningTimeout(std::nullopt);
+            }
+        }
+        for (uint32_t i = 0; i < apNodes.GetN(); i++)
+        {
+            Ptr<NetDevice> dev = apNodes.Get(i)->GetDevice(0);
+            Ptr<WifiNetDevice> wifi_dev = DynamicCast<WifiNetDevice>(dev);
+
+            Ptr<WifiPhy> dev_phy = wifi_dev->GetPhy();
+            dev_phy->SetCcaSensitivityThreshold(-82);
+            dev_phy->SetTxPowerStart(35);
+            dev_phy->SetTxPowerEnd(35);
+        }
+        checkAssociationEvent = Simulator::Schedule(Seconds(1), &CheckAssociation);
+    }
+    else
+    {
+        std::cout << "associated N Sta: " << associatedStas << std::endl;
+        if (appType == "setup")
+        {
+            SaveSnapshot();
+            Simulator::Stop();
+            return;
+        }
+        ApplyMeasurementSettings();
+    }
+}
+
+void
+AssociatedSta(uint32_t apId, uint16_t aid, Mac48Address addy /* addr */)
+{
+    ProfileScope scope("AssociatedSta");
+    uint32_t staId = MacAddressToNodeId(addy);
+    if (nodeRegistry[staId].associatedAp == NodeInfo::NO_NODE)
+    {
+        associatedStas++; // re-associations do not count, associatedStas counts distinct STAs
+    }
+    nodeRegistry[staId].associatedAp = apId;
+    std::cout << "Node " << staId << " associated at T=" << Simulator::Now().GetSeconds()
+              << std::endl;
+    if ((preassociate || appType == "setup-done") && associatedStas == staNodes.GetN())
+    {
+        // Pinned associations are done, no need to wait for the polling check
+        checkAssociationEvent.Cancel();
+        checkAssociationEvent = Simulator::ScheduleNow(&CheckAssociation);
+    }
+}
+
+void
+DeAssociatedSta(uint16_t aid, Mac48Address /* addr */)
+{
+    deassociatedStas++;
+}
+
+/**
+ * With preassociate there is no polling: report the STAs that missed the measurement start, and
+ * apply the measurement settings that CheckAssociation would only apply once all are associated
+ */
+void
+WarnUnassociated()
+{
+    if (associatedStas < staNodes.GetN())
+    {
+        std::cout << "WARNING: " << staNodes.GetN() - associatedStas
+                  << " STAs not associated at measurement start" << std::endl;
+        ApplyMeasurementSettings();
+    }
+}
+
+std::string
+AddressToString(const Address& addr)
+{
+    std::stringstream addressStr;
+    addressStr << InetSocketAddress::ConvertFrom(addr).GetIpv4() << ":"
+               << InetSocketAddress::ConvertFrom(addr).GetPort();
+    return addressStr.str();
+}
+
+struct Point
+{
+    double x;
+    double y;
+};
+
+Point
+generateRandomPointInCircle(double radius, Point origin)
+{
+    Point result;
+
+    double randomRadius = sqrt(radius * radius * randomAngle->GetValue(0.0, 1.0));
+    while (randomRadius < 1)
+    {
+        randomRadius = sqrt(radius * radius * randomAngle->GetValue(0.0, 1.0));
+    }
+    double randomAngleInRadians = 2 * M_PI * randomAngle->GetValue(0.0, 1.0);
+
+    result.x = origin.x + randomRadius * cos(randomAngleInRadians);
+    result.y = origin.y + randomRadius * sin(randomAngleInRadians);
+
+    return result;
+}
+
+/**
+ * AP positions for --apLayout, distanceAps apart:
+ * grid: rows of ceil(sqrt(n)) APs, starting at (distanceAps / 2, distanceAps / 2);
+ * hex: the same rows, every other row shifted by half a spacing and rows sqrt(3) / 2 apart;
+ * poisson: uniformly random over the square a grid of apMeanCount APs would cover; with the AP
+ * count drawn by DrawPoissonApCount, a Poisson point process of that AP density.
+ */
+std::vector<Point>
+PlaceAps(uint32_t n)
+{
+    uint32_t gridAps = (apLayout == "poisson") ? apMeanCount : n;
+    uint32_t columns = std::max(1U, static_cast<uint32_t>(std::ceil(std::sqrt(gridAps))));
+    double spacing = distanceAps;
+    std::vector<Point> positions(n);
+    if (apLayout == "poisson")
+    {
+        Ptr<UniformRandomVariable> coordinate = CreateObject<UniformRandomVariable>();
+        coordinate->SetAttribute("Stream", IntegerValue(seedNumber + 3));
+        for (Point& position : positions)
+        {
+            position.x = coordinate->GetValue(0, columns * spacing);
+            position.y = coordinate->GetValue(0, columns * spacing);
+        }
+        return positions;
+    }
+    NS_ABORT_MSG_IF(apLayout != "grid" && apLayout != "hex", "Unknown AP layout " << apLayout);
+    for (uint32_t i = 0; i < n; i++)
+    {
+        uint32_t row = i / columns;
+        uint32_t column = i % columns;
+        positions[i].x = spacing / 2 + column * spacing;
+        positions[i].y = spacing / 2 + row * spacing;
+        if (apLayout == "hex")
+        {
+            positions[i].x += (row % 2) * spacing / 2;
+            positions[i].y = spacing / 2 + row * spacing * std::sqrt(3) / 2;
+        }
+    }
+    return positions;
+}
+
+/**
+ * Number of APs of apLayout=poisson: Poisson distributed with mean apNodes, drawn once per
+ * process from the seed so that replications and cached runs share it. At least one AP.
+ */
+int
+DrawPoissonApCount(int mean)
+{
+    std::mt19937_64 rng(seedNumber);
+    return std::max(1, std::poisson_distribution<int>(mean)(rng));
+}
+
+/// Wall clock marks of the run phases, for --bench
+struct BenchClock
+{
+    using Clock = std::chrono::steady_clock;
+    Clock::time_point start;   ///< main() entered
+    Clock::time_point run;     ///< Simulator::Run() called
+    Clock::time_point measure; ///< simulated time reached warmup
+    Clock::time_point end;     ///< Simulator::Run() returned
+};
+
+BenchClock benchClock;
+
+void
+MarkMeasurementStart()
+{
+    benchClock.measure = BenchClock::Clock::now();
+}
+
+/// One line for benchmark.py: seconds per phase, executed events and peak RSS
+void
+PrintBench()
+{
+    auto seconds = [](BenchClock::Clock::time_point from, BenchClock::Clock::time_point to) {
+        return std::chrono::duration<double>(to - from).count();
+    };
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    std::cout << "BENCH setup=" << seconds(benchClock.start, benchClock.run)
+              << " warmup=" << seconds(benchClock.run, benchClock.measure)
+              << " measure=" << seconds(benchClock.measure, benchClock.end)
+              << " events=" << Simulator::GetEventCount() << " maxRssKb=" << usage.ru_maxrss
+              << std::endl;
+}
+
+/*
+ * Sweep mode
+ *
+ * A sweep grid is a ';' separated list of "name=values" entries, where values is either a ','
+ * separated list or a "start:stop:step" range, e.g.
+ * "apNodes=2,3,4;distanceAps=5,15,30;ccaSensitivity=-82:-62:2;rng=1:5:1".
+ * Every point of the cartesian product runs as its own worker process (this binary with the
+ * point's values added to the command line) inside <sweepStore>.d/<hash>/, where its stdout and
+ * output files are kept. A worker appends one line to the results store when its trial
+ * completes, so killing the sweep never loses a finished point, and re-running the same sweep
+ * skips every point whose hash is already in the store. Relative paths passed as options are
+ * resolved from the worker directory.
+ */
+
+using SweepArgs = std::map<std::string, std::string>; ///< option name -> value
+
+volatile std::sig_atomic_t sweepInterrupted = 0; ///< Set when the sweep gets SIGINT/SIGTERM
+
+void
+SweepSignalHandler(int /* signum */)
+{
+    sweepInterrupted = 1;
+}
+
+/// Options that control the sweep itself and are not part of a point's identity
+bool
+IsSweepOption(const std::string& name)
+{
+    return name == "sweep" || name == "sweepWorkers" || name == "sweepStore" ||
+           name == "sweepKey" || name == "sweepPrune" || name == "sweepPruneBy";
+}
+
+/// Collect "--name=value" options (bare flags get "true") from the command line
+SweepArgs
+SweepArgsFromArgv(int argc, char* argv[])
+{
+    SweepArgs args;
+    for (int i = 1; i < argc; i++)
+    {
+        std::string arg(argv[i]);
+        auto start = arg.find_first_not_of('-');
+        if (start == 0 || start == std::string::npos)
+        {
+            continue;
+        }
+        arg = arg.substr(start);
+        auto eq = arg.find('=');
+        std::string name = arg.substr(0, eq);
+        if (!IsSweepOption(name))
+        {
+            args[name] = (eq == std::string::npos) ? "true" : arg.substr(eq + 1);
+        }
+    }
+    return args;
+}
+
+/// Canonical (sorted) command line of a sweep point, used as the identity of the point
+std::string
+CanonicalSweepArgs(const SweepArgs& args)
+{
+    std::string canonical;
+    for (const auto& [name, value] : args)
+    {
+        canonical += (canonical.empty() ? "--" : " --") + name + "=" + value;
+    }
+    return canonical;
+}
+
+/// 64 bit FNV-1a hash of a string, printed as 16 hex digits
+std::string
+HashString(const std::string& s)
+{
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    for (unsigned char c : s)
+    {
+        hash ^= c;
+        hash *= 0x100000001b3ULL;
+    }
+    std::ostringstream hex;
+    hex << std::hex << std::setw(16) << std::setfill('0') << hash;
+    return hex.str();
+}
+
+/// Expand "a,b,c" or "start:stop:step" into the list of values to sweep
+std::vector<std::string>
+ExpandSweepValues(const std::string& spec)
+{
+    std::vector<std::string> values;
+    if (std::count(spec.begin(), spec.end(), ':') == 2)
+    {
+        auto c1 = spec.find(':');
+        auto c2 = spec.find(':', c1 + 1);
+        double start = std::stod(spec.substr(0, c1));
+        double stop = std::stod(spec.substr(c1 + 1, c2 - c1 - 1));
+        double step = std::stod(spec.substr(c2 + 1));
+        NS_ABORT_MSG_IF(step == 0 || (stop - start) / step < 0, "Invalid sweep range " << spec);
+        auto n = static_cast<uint64_t>(std::floor((stop - start) / step + 1e-9));
+        for (uint64_t k = 0; k <= n; k++)
+        {
+            std::ostringstream value;
+            value << std::setprecision(12) << start + k * step;
+            values.push_back(value.str());
+        }
+        return values;
+    }
+    std::stringstream list(spec);
+    std::string value;
+    while (std::getline(list, value, ','))
+    {
+        if (!value.empty())
+        {
+            values.push_back(value);
+        }
+    }
+    NS_ABORT_MSG_IF(values.empty(), "No values in sweep entry " << spec);
+    return values;
+}
+
+/// Expand the sweep grid on top of the base command line into the list of points to run
+std::vector<SweepArgs>
+ExpandSweepGrid(const std::string& grid, const SweepArgs& base)
+{
+    std::vector<SweepArgs> points{base};
+    std::stringstream entries(grid);
+    std::string entry;
+    while (std::getline(entries, entry, ';'))
+    {
+        auto eq = entry.find('=');
+        NS_ABORT_MSG_IF(eq == std::string::npos || eq == 0, "Invalid sweep entry " << entry);
+        std::string name = entry.substr(0, eq);
+        std::vector<SweepArgs> expanded;
+        for (const auto& point : points)
+        {
+            for (const auto& value : ExpandSweepValues(entry.substr(eq + 1)))
+            {
+                SweepArgs next = point;
+                next[name] = value;
+                expanded.push_back(next);
+            }
+        }
+        points.swap(expanded);
+    }
+    return points;
+}
+
+/// Hashes of the points already in the results store (a torn last line is ignored)
+std::set<std::string>
+ReadSweepStore(const std::string& path)
+{
+    std::set<std::string> done;
+    std::ifstream in(path);
+    std::string line;
+    while (std::getline(in, line))
+    {
+        auto tab = line.find('\t');
+        if (!in.eof() && tab == 16)
+        {
+            done.insert(line.substr(0, tab));
+        }
+    }
+    return done;
+}
+
+/// Append one complete line to the results store. The append is done with a single write under
+/// an exclusive lock and synced, so concurrent workers never interleave or lose lines.
+void
+AppendSweepStore(const std::string& path, const std::string& line)
+{
+    int fd = open(path.c_str(), O_WRONLY | O_APPEND | O_CREAT, 0644);
+    NS_ABORT_MSG_IF(fd < 0, "Cannot open results store " << path);
+    flock(fd, LOCK_EX);
+    NS_ABORT_MSG_IF(write(fd, line.data(), line.size()) != static_cast<ssize_t>(line.size()),
+                    "Short write to results store " << path);
+    fsync(fd);
+    flock(fd, LOCK_UN);
+    close(fd);
+}
+
+/**
+ * Called at the end of a sweep worker's trials to record the finished point: the means over
+ * the replications, and the fewest STAs any replication associated
+ */
+void
+RecordSweepResult(int argc,
+                  char* argv[],
+                  const std::vector<TrialResult>& results,
+                  const std::string& extra = "")
+{
+    auto fewest = std::min_element(results.begin(),
+                                   results.end(),
+                                   [](const TrialResult& a, const TrialResult& b) {
+                                       return a.associatedStas < b.associatedStas;
+                                   });
+    std::ostringstream line;
+    line << sweepKey << "\t" << CanonicalSweepArgs(SweepArgsFromArgv(argc, argv)) << "\t"
+         << "associatedStas=" << fewest->associatedStas
+         << " deassociatedStas=" << fewest->deassociatedStas;
+    if (!results.front().bssThroughput.empty())
+    {
+        auto [throughput, throughputCi] =
+            MeanCi(Collect(results, [](const TrialResult& r) { return r.throughput; }));
+        line << " throughput=" << throughput << " throughputCi=" << throughputCi
+             << " fairness="
+             << MeanCi(Collect(results, [](const TrialResult& r) { return r.fairness; })).first
+             << " measured="
+             << MeanCi(Collect(results, [](const TrialResult& r) { return r.measured; })).first;
+        for (std::size_t bss = 0; bss < results.front().bssThroughput.size(); bss++)
+        {
+            line << " bss" << bss << "="
+                 << MeanCi(Collect(results, [&](const TrialResult& r) {
+                        return r.bssThroughput[bss];
+                    })).first;
+        }
+    }
+    line << extra << "\n";
+    AppendSweepStore(sweepStore, line.str());
+}
+
+/**
+ * Append the result of an app=poisson run to arrivalOutput (multi-bss.dat, read by vers5.py) as
+ * "lambda,throughput,throughputCi,fairness,numBSS,networkSize,ccaPd,rng,bss0,bss1,...", means
+ * over the replications, with no header so that runs of any number of BSSs share the file
+ */
+void
+AppendArrivalResult(const std::vector<TrialResult>& results)
+{
+    if (results.front().bssThroughput.empty())
+    {
+        return;
+    }
+    auto [throughput, throughputCi] =
+        MeanCi(Collect(results, [](const TrialResult& r) { return r.throughput; }));
+    std::ostringstream line;
+    line << std::setprecision(10) << trafficArrivalRate << "," << throughput << ","
+         << throughputCi << ","
+         << MeanCi(Collect(results, [](const TrialResult& r) { return r.fairness; })).first << ","
+         << apNodeCount << "," << networkSize << "," << ccaSensitivity << "," << seedNumber;
+    for (std::size_t bss = 0; bss < results.front().bssThroughput.size(); bss++)
+    {
+        line << ","
+             << MeanCi(Collect(results, [&](const TrialResult& r) {
+                    return r.bssThroughput[bss];
+                })).first;
+    }
+    line << "\n";
+    AppendSweepStore(arrivalOutput, line.str());
+}
+
+/// Fork a worker process running a single sweep point in its own directory
+pid_t
+LaunchSweepWorker(const std::string& key,
+                  const SweepArgs& args,
+                  const std::string& store,
+                  const std::string& workDir)
+{
+    std::vector<std::string> workerArgs{"multi-bss"};
+    for (const auto& [name, value] : args)
+    {
+        workerArgs.push_back("--" + name + "=" + value);
+    }
+    workerArgs.push_back("--sweepKey=" + key);
+    workerArgs.push_back("--sweepStore=" + store);
+    std::string dir = workDir + "/" + key;
+
+    pid_t pid = fork();
+    NS_ABORT_MSG_IF(pid < 0, "Cannot fork sweep worker");
+    if (pid == 0)
+    {
+        mkdir(dir.c_str(), 0755);
+        int out = open((dir + "/stdout.txt").c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (chdir(dir.c_str()) != 0 || out < 0)
+        {
+            _exit(127);
+        }
+        dup2(out, STDOUT_FILENO);
+        dup2(out, STDERR_FILENO);
+        close(out);
+        std::vector<char*> workerArgv;
+        for (auto& arg : workerArgs)
+        {
+            workerArgv.push_back(arg.data());
+        }
+        workerArgv.push_back(nullptr);
+        execv("/proc/self/exe", workerArgv.data());
+        _exit(127);
+    }
+    return pid;
+}
+
+using SweepPoints = std::vector<std::pair<std::string, SweepArgs>>; ///< (hash, point) pairs
+
+/// Run the points on up to workers processes, each appending its result to store; returns the
+/// number of points that failed
+uint32_t
+RunSweepPoints(const SweepPoints& pending,
+               const std::string& store,
+               const std::string& workDir,
+               uint32_t workers)
+{
+    std::map<pid_t, std::string> running;
+    std::size_t next = 0;
+    uint32_t finished = 0;
+    uint32_t failed = 0;
+    bool stopping = false;
+    while ((next < pending.size() && !sweepInterrupted) || !running.empty())
+    {
+        if (sweepInterrupted && !stopping)
+        {
+            // Unfinished points are simply not in the store and will be run again next time
+            std::cout << "SWEEP: interrupted, stopping " << running.size() << " workers"
+                      << std::endl;
+            for (const auto& [pid, key] : running)
+            {
+                kill(pid, SIGTERM);
+            }
+            stopping = true;
+        }
+        while (!sweepInterrupted && next < pending.size() && running.size() < workers)
+        {
+            pid_t pid =
+                LaunchSweepWorker(pending[next].first, pending[next].second, store, workDir);
+            running[pid] = pending[next].first;
+            next++;
+        }
+
+        int status;
+        pid_t pid = waitpid(-1, &status, 0);
+        if (pid < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            break;
+        }
+        auto it = running.find(pid);
+        if (it == running.end())
+        {
+            continue;
+        }
+        if (WIFEXITED(status) && WEXITSTATUS(status) == 0)
+        {
+            finished++;
+        }
+        else if (!stopping)
+        {
+            failed++;
+            std::cout << "SWEEP: point " << it->second << " failed, see " << workDir << "/"
+                      << it->second << "/stdout.txt" << std::endl;
+        }
+        running.erase(it);
+        std::cout << "SWEEP: " << finished << "/" << pending.size() << " done" << std::endl;
+    }
+    std::cout << "SWEEP: finished " << finished << ", failed " << failed << ", results in "
+              << store << std::endl;
+    return failed;
+}
+
+/// Estimated aggregate throughput of the points in an --estimate=only results store, by hash
+std::map<std::string, double>
+ReadSweepEstimates(const std::string& path)
+{
+    std::map<std::string, double> estimates;
+    std::ifstream in(path);
+    std::string line;
+    while (std::getline(in, line))
+    {
+        auto tab = line.find('\t');
+        auto field = line.find(" throughput=");
+        if (!in.eof() && tab == 16 && field != std::string::npos)
+        {
+            estimates[line.substr(0, tab)] = std::atof(line.c_str() + field + 12);
+        }
+    }
+    return estimates;
+}
+
+/// The point as run by the estimate pass of --sweepPrune
+SweepArgs
+EstimatePoint(SweepArgs point)
+{
+    point["estimate"] = "only";
+    return point;
+}
+
+/**
+ * Drop the pending points whose estimated throughput is more than sweepPrune below the best
+ * estimate among the points that only differ from them in sweepPruneBy. The estimates of every
+ * point are computed first by --estimate=only workers, kept in their own store next to the
+ * results store so that they are reused by the next run of the sweep.
+ */
+SweepPoints
+PruneSweepPoints(const std::vector<SweepArgs>& points,
+                 const SweepPoints& pending,
+                 const std::string& workDir,
+                 uint32_t workers)
+{
+    std::string estimateStore = sweepStore + ".estimate";
+    std::set<std::string> estimated = ReadSweepStore(estimateStore);
+    SweepPoints toEstimate;
+    for (const auto& point : points)
+    {
+        std::string key = HashString(CanonicalSweepArgs(EstimatePoint(point)));
+        if (estimated.insert(key).second)
+        {
+            toEstimate.emplace_back(key, EstimatePoint(point));
+        }
+    }
+    std::cout << "SWEEP: estimating " << toEstimate.size() << " points" << std::endl;
+    RunSweepPoints(toEstimate, estimateStore, workDir, workers);
+    std::map<std::string, double> estimates = ReadSweepEstimates(estimateStore);
+
+    // Best estimate of every group of points that only differ in sweepPruneBy
+    auto groupOf = [](SweepArgs point) {
+        point.erase(sweepPruneBy);
+        return CanonicalSweepArgs(point);
+    };
+    auto estimateOf = [&](const SweepArgs& point) {
+        auto it = estimates.find(HashString(CanonicalSweepArgs(EstimatePoint(point))));
+        return it == estimates.end() ? std::numeric_limits<double>::infinity() : it->second;
+    };
+    std::map<std::string, double> best;
+    for (const auto& point : points)
+    {
+        double estimate = estimateOf(point);
+        if (std::isfinite(estimate))
+        {
+            auto [it, inserted] = best.emplace(groupOf(point), estimate);
+            it->second = std::max(it->second, estimate);
+        }
+    }
+
+    SweepPoints kept;
+    for (const auto& [key, point] : pending)
+    {
+        // Points without an estimate (failed estimate worker) are kept
+        auto it = best.find(groupOf(point));
+        if (it == best.end() || estimateOf(point) >= (1 - sweepPrune) * it->second)
+        {
+            kept.emplace_back(key, point);
+        }
+    }
+    std::cout << "SWEEP: pruned " << pending.size() - kept.size() << " points estimated more than "
+              << 100 * sweepPrune << "% below the best " << sweepPruneBy << std::endl;
+    return kept;
+}
+
+/// Run every point of sweepGrid that is not yet in the results store on sweepWorkers processes
+int
+RunSweep(int argc, char* argv[])
+{
+    char cwd[4096];
+    NS_ABORT_MSG_IF(!getcwd(cwd, sizeof(cwd)), "Cannot resolve results store path");
+    if (sweepStore.front() != '/')
+    {
+        sweepStore = std::string(cwd) + "/" + sweepStore;
+    }
+    std::string workDir = sweepStore + ".d";
+    mkdir(workDir.c_str(), 0755);
+
+    std::vector<SweepArgs> points = ExpandSweepGrid(sweepGrid, SweepArgsFromArgv(argc, argv));
+    for (auto& point : points)
+    {
+        // Workers run in their own directory but share the cache
+        auto cache = point.find("cache");
+        if (cache != point.end() && !cache->second.empty() && cache->second.front() != '/')
+        {
+            cache->second = std::string(cwd) + "/" + cache->second;
+        }
+    }
+    std::set<std::string> done = ReadSweepStore(sweepStore);
+    SweepPoints pending;
+    std::set<std::string> distinct; // the grid can expand to the same point more than once
+    uint32_t alreadyDone = 0;
+    for (const auto& point : points)
+    {
+        std::string key = HashString(CanonicalSweepArgs(point));
+        if (!distinct.insert(key).second)
+        {
+            continue;
+        }
+        if (done.count(key) > 0)
+        {
+            alreadyDone++;
+        }
+        else
+        {
+            pending.emplace_back(key, point);
+        }
+    }
+    uint32_t workers = sweepWorkers;
+    if (workers == 0)
+    {
+        workers = std::max(1U, std::thread::hardware_concurrency());
+    }
+
+    // No SA_RESTART so that waitpid returns on SIGINT/SIGTERM and the workers can be stopped
+    struct sigaction action = {};
+    action.sa_handler = SweepSignalHandler;
+    sigaction(SIGINT, &action, nullptr);
+    sigaction(SIGTERM, &action, nullptr);
+
+    if (sweepPrune > 0 && !pending.empty())
+    {
+        pending = PruneSweepPoints(points, pending, workDir, workers);
+    }
+    std::cout << "SWEEP: " << distinct.size() << " points, " << alreadyDone
+              << " already done, running " << pending.size() << " on " << workers
+              << " workers" << std::endl;
+
+    uint32_t failed = RunSweepPoints(pending, sweepStore, workDir, workers);
+    return (sweepInterrupted || failed > 0) ? 1 : 0;
+}
+
+/*
+ * Result cache (--cache)
+ *
+ * The results of a run are stored under a hash of the value of every option, defaults
+ * included, and of the executable and ns-3 libraries it runs with, so an identical run of the
+ * same build returns them without simulating. Options that only drive the sweep, the cache or
+ * diagnostics are not part of the key. The cache is a text file with one
+ * "hash<TAB>options<TAB>results" line per entry, appended like the sweep results store so that
+ * parallel workers can share it, and the last entry of a hash wins. --cacheVerify re-simulates
+ * that fraction of the hits and reports any difference with the cached results. Runs that
+ * write traces, telemetry, occupancy, a profile or a BENCH line always simulate, since a hit
+ * only restores the results.
+ */
+
+/// Options that do not change the simulated results
+bool
+IsCacheNeutralOption(const std::string& name)
+{
+    return IsSweepOption(name) || name == "cache" || name == "cacheVerify" || name == "bench" ||
+           name == "profile";
+}
+
+/// First option of the run that writes files or diagnostics a cache hit would not produce
+/// (empty if none): such runs bypass the cache
+std::string
+SideOutputOption()
+{
+    if (enablePhyTraceHelper)
+    {
+        return "enablePhyTraceHelper";
+    }
+    if (!telemetryFile.empty())
+    {
+        return "telemetry";
+    }
+    if (!occupancyFile.empty())
+    {
+        return "occupancy";
+    }
+    if (!profileFile.empty())
+    {
+        return "profile";
+    }
+    if (bench)
+    {
+        return "bench";
+    }
+    return "";
+}
+
+/// CommandLine that also keeps track of every option value, for the cache key
+class RecordingCommandLine : public CommandLine
+{
+  public:
+    using CommandLine::CommandLine;
+
+    template <typename T>
+    void AddValue(const std::string& name, const std::string& help, T& value)
+    {
+        CommandLine::AddValue(name, help, value);
+        m_values[name] = [&value]() {
+            std::ostringstream os;
+            os << std::setprecision(17);
+            if constexpr (std::is_same_v<T, uint8_t>)
+            {
+                os << +value;
+            }
+            else
+            {
+                os << value;
+            }
+            return os.str();
+        };
+    }
+
+    /// Parse, keeping the "--ns3::Type::Attribute=value" overrides which are not AddValue options
+    void Parse(int argc, char* argv[])
+    {
+        for (int i = 1; i < argc; i++)
+        {
+            std::string arg = argv[i];
+            arg.erase(0, arg.find_first_not_of('-'));
+            if (arg.rfind("ns3::", 0) == 0)
+            {
+                auto eq = arg.find('=');
+                m_attributes[arg.substr(0, eq)] =
+                    eq == std::string::npos ? "" : arg.substr(eq + 1);
+            }
+        }
+        CommandLine::Parse(argc, argv);
+    }
+
+    /// Sorted "--name=value" list of the current value of every option that shapes the results
+    std::string Canonical() const;
+
+  private:
+    std::map<std::string, std::function<std::string()>> m_values; ///< Option name -> value
+    std::map<std::string, std::string> m_attributes; ///< Attribute override -> value, last wins
+};
+
+std::string
+RecordingCommandLine::Canonical() const
+{
+    SweepArgs args;
+    for (const auto& [name, value] : m_values)
+    {
+        if (!IsCacheNeutralOption(name))
+        {
+            args[name] = value();
+        }
+    }
+    for (const auto& [name, value] : m_attributes)
+    {
+        args[name] = value;
+    }
+    return CanonicalSweepArgs(args);
+}
+
+/// Hash of the content of a file, read in chunks; a missing file hashes as empty
+std::string
+HashFile(const std::string& file)
+{
+    std::string hashes;
+    std::vector<char> chunk(1 << 20);
+    std::ifstream in(file, std::ios::binary);
+    while (in.read(chunk.data(), chunk.size()) || in.gcount() > 0)
+    {
+        hashes += HashString(std::string(chunk.data(), in.gcount()));
+    }
+    return HashString(hashes);
+}
+
+/// Hash of the executable and of the ns-3 libraries mapped in this process
+std::string
+BuildHash()
+{
+    std::set<std::string> files{"/proc/self/exe"};
+    std::ifstream maps("/proc/self/maps");
+    std::string line;
+    while (std::getline(maps, line))
+    {
+        auto path = line.find('/');
+        if (path != std::string::npos && line.find("libns3", path) != std::string::npos)
+        {
+            files.insert(line.substr(path));
+        }
+    }
+    std::string hashes;
+    for (const auto& file : files)
+    {
+        hashes += HashFile(file);
+    }
+    return HashString(hashes);
+}
+
+/// Hash of the content of the input files the run reads: the traffic traces and the snapshot
+std::string
+InputHash()
+{
+    std::set<std::string> files;
+    if (appType == "bursty-trace")
+    {
+        for (uint32_t sta = 0; sta < apNodeCount * networkSize; sta++)
+        {
+            std::string path = trafficTrace;
+            std::size_t at = path.find("{sta}");
+            if (at != std::string::npos)
+            {
+                path.replace(at, 5, std::to_string(sta));
+            }
+            files.insert(path);
+        }
+    }
+    if (appType == "setup-done")
+    {
+        files.insert(snapshotFile);
+    }
+    std::string hashes;
+    for (const auto& file : files)
+    {
+        hashes += file + "=" + HashFile(file) + " ";
+    }
+    return HashString(hashes);
+}
+
+/// One line of "name=value" fields per trial result, the trials separated by ';'
+std::string
+SerializeResults(const std::vector<TrialResult>& results)
+{
+    std::ostringstream out;
+    out << std::setprecision(17);
+    for (std::size_t i = 0; i < results.size(); i++)
+    {
+        const TrialResult& r = results[i];
+        out << (i > 0 ? ";" : "") << "associatedStas=" << r.associatedStas
+            << " deassociatedStas=" << r.deassociatedStas << " measured=" << r.measured
+            << " throughput=" << r.throughput << " fairness=" << r.fairness << " bss=";
+        for (std::size_t bss = 0; bss < r.bssThroughput.size(); bss++)
+        {
+            out << (bss > 0 ? "," : "") << r.bssThroughput[bss];
+        }
+    }
+    return out.str();
+}
+
+/// Inverse of SerializeResults
+std::vector<TrialResult>
+ParseResults(const std::string& text)
+{
+    std::vector<TrialResult> results;
+    std::stringstream trials(text);
+    std::string trial;
+    while (std::getline(trials, trial, ';'))
+    {
+        TrialResult r;
+        std::stringstream fields(trial);
+        std::string field;
+        while (fields >> field)
+        {
+            auto eq = field.find('=');
+            std::string name = field.substr(0, eq);
+            std::string value = field.substr(eq + 1);
+            if (name == "associatedStas")
+            {
+                r.associatedStas = std::stoul(value);
+            }
+            else if (name == "deassociatedStas")
+            {
+                r.deassociatedStas = std::stoul(value);
+            }
+            else if (name == "measured")
+            {
+                r.measured = std::stod(value);
+            }
+            else if (name == "throughput")
+            {
+                r.throughput = std::stod(value);
+            }
+            else if (name == "fairness")
+            {
+                r.fairness = std::stod(value);
+            }
+            else if (name == "bss")
+            {
+                std::stringstream list(value);
+                std::string throughput;
+                while (std::getline(list, throughput, ','))
+                {
+                    r.bssThroughput.push_back(std::stod(throughput));
+                }
+            }
+        }
+        results.push_back(r);
+    }
+    return results;
+}
+
+/// Results cached under key, empty if there are none (a torn last line is ignored)
+std::vector<TrialResult>
+LookupCache(const std::string& path, const std::string& key)
+{
+    std::string found;
+    std::ifstream in(path);
+    std::string line;
+    while (std::getline(in, line))
+    {
+        auto tab = line.rfind('\t');
+        if (!in.eof() && line.compare(0, key.size() + 1, key + "\t") == 0)
+        {
+            found = line.substr(tab + 1);
+        }
+    }
+    return found.empty() ? std::vector<TrialResult>() : ParseResults(found);
+}
+
+/// Largest relative difference between the throughputs of two sets of results
+double
+ResultsDifference(const std::vector<TrialResult>& a, const std::vector<TrialResult>& b)
+{
+    if (a.size() != b.size())
+    {
+        return std::numeric_limits<double>::infinity();
+    }
+    auto relative = [](double x, double y) {
+        return x == y ? 0 : std::abs(x - y) / std::max(std::abs(x), std::abs(y));
+    };
+    double worst = 0;
+    for (std::size_t i = 0; i < a.size(); i++)
+    {
+        if (a[i].bssThroughput.size() != b[i].bssThroughput.size())
+        {
+            return std::numeric_limits<double>::infinity();
+        }
+        worst = std::max(worst, relative(a[i].throughput, b[i].throughput));
+        for (std::size_t bss = 0; bss < a[i].bssThroughput.size(); bss++)
+        {
+            worst = std::max(worst, relative(a[i].bssThroughput[bss], b[i].bssThroughput[bss]));
+        }
+    }
+    return worst;
+}
+
+/// Print cached results like a run would
+void
+PrintCachedResults(const std::vector<TrialResult>& results)
+{
+    if (results.size() > 1)
+    {
+        PrintReplicationSummary(results);
+        return;
+    }
+    const TrialResult& result = results.front();
+    for (std::size_t bss = 0; bss < result.bssThroughput.size(); bss++)
+    {
+        std::cout << "BSS " << bss << ": " << result.bssThroughput[bss] << " Mbps" << std::endl;
+    }
+    if (!result.bssThroughput.empty())
+    {
+        std::cout << "Throughput: " << result.throughput << " Mbps" << std::endl;
+        std::cout << "Fairness: " << result.fairness << std::endl;
+    }
+}
+
+/// Clear what a previous trial left in the globals, before the nodes are created again
+void
+ResetTrialState()
+{
+    apNodes = NodeContainer();
+    staNodes = NodeContainer();
+    wifiNodes = NodeContainer();
+    apDevices = NetDeviceContainer();
+    staDevices = NetDeviceContainer();
+    devices = NetDeviceContainer();
+    nodeRegistry.clear();
+    nodeTxVector.clear();
+    dataRateToMcs.clear();
+    associatedStas = 0;
+    deassociatedStas = 0;
+    checkAssociationEvent = EventId();
+    checkStatsEvent = EventId();
+    bssCounters.clear();
+    bssBatches.clear();
+    nBatches = 0;
+    lossMatrix = nullptr;
+    channelLoss = nullptr;
+    maxLossDb = std::numeric_limits<double>::infinity();
+    timelineStats = TimelineStatistics();
+    timelineBatch.clear();
+    rxAggregate = RxAggregate();
+    occupancy = Occupancy();
+    wifiStats.Reset();
+}
+
+/// path with the -r<replication> suffix before its extension when there are replications
+std::string
+ReplicationPath(std::string path, uint32_t replication)
+{
+    if (replications > 1)
+    {
+        std::size_t dot = path.rfind('.');
+        std::size_t slash = path.rfind('/');
+        if (dot == std::string::npos || (slash != std::string::npos && dot < slash))
+        {
+            dot = path.size();
+        }
+        path.insert(dot, "-r" + std::to_string(replication));
+    }
+    return path;
+}
+
+uint32_t trialCount = 0; ///< Trials run so far in this process
+double durationCap = 0;  ///< duration as given on the command line
+
+/**
+ * Build the scenario, run it and tear it down. Trials share the process but nothing else:
+ * every one builds its nodes from scratch after the previous Simulator::Destroy(), and runs
+ * with RNG run number seedNumber + replication, so the streams of replications are independent.
+ */
+TrialResult
+RunTrial(uint32_t replication)
+{
+    int mcs = -1;
+
+    if (trialCount++ > 0)
+    {
+        benchClock.start = BenchClock::Clock::now();
+        ResetTrialState();
+    }
+    if (replication > 0)
+    {
+        std::cout << "Replication " << replication << std::endl;
+    }
+    if (profiling)
+    {
+        Simulator::SetScheduler(ObjectFactory("ns3::ProfilingScheduler"));
+    }
+    RngSeedManager::SetRun(seedNumber + replication);
+
+    // If not default get value from command line "HeMcs10"
+    if ((phyMode != "OfdmRate54Mbps") && (phyMode != "auto") && (phyMode != "ideal"))
+    {
+        mcs = std::stoi(phyMode.substr(phyMode.find("s") + 1));
+    }
+
+    apNodes.Create(apNodeCount);
     staNodes.Create(apNodeCount * networkSize);
+    nodeRegistry.assign(NodeList::GetNNodes(), NodeInfo());
+
+    TopologySnapshot snapshot;
+    if (appType == "setup-done")
+    {
+        snapshot = LoadSnapshot();
+    }
 
     WifiStandard wifiStandard;
     if (standard == "11a")
@@ -510,15 +4658,20 @@ main(int argc, char* argv[])
         NS_FATAL_ERROR("Unsupported standard: " << standard);
     }
 
-    if (appType != "setup-done")
+    std::string channelStr = "{0, " + std::to_string(channelWidth) + ", BAND_" +
+                             (frequency == 2.4 ? "2_4" : (frequency == 5 ? "5" : "6")) + "GHZ, 0}";
+    Config::SetDefault("ns3::WifiPhy::ChannelSettings", StringValue(channelStr));
+
+    if (phyEngine == "yans" && channelWidth > 22)
     {
-        std::string channelStr = "{0, " + std::to_string(channelWidth) + ", BAND_" +
-                                 (frequency == 2.4 ? "2_4" : (frequency == 5 ? "5" : "6")) +
-                                 "GHZ, 0}";
-        Config::SetDefault("ns3::WifiPhy::ChannelSettings", StringValue(channelStr));
+        // YansWifiPhy has no per-20 MHz CCA, so the secondary channel ED thresholds would be
+        // ignored
+        std::cout << "WARNING: phyEngine=yans only models single 20 MHz channels, using spectrum"
+                  << std::endl;
+        phyEngine = "spectrum";
     }
-
-    Ptr<MultiModelSpectrumChannel> spectrumChannel = CreateObject<MultiModelSpectrumChannel>();
+    NS_ABORT_MSG_IF(phyEngine != "spectrum" && phyEngine != "yans",
+                    "Unsupported PHY engine " << phyEngine);
 
     if (frequency == 6)
     {
@@ -530,12 +4683,13 @@ main(int argc, char* argv[])
             lossModel->SetAttribute("Exponent", DoubleValue(2.0));
             lossModel->SetAttribute("ReferenceDistance", DoubleValue(1.0));
             lossModel->SetAttribute("ReferenceLoss", DoubleValue(49.013));
-            spectrumChannel->AddPropagationLossModel(lossModel);
+            SetChannelLoss(lossModel);
         }
         else if (propagationModel == "fixed")
         {
             Ptr<FixedRssLossModel> lossModel = CreateObject<FixedRssLossModel>();
             lossModel->SetAttribute("Rss", DoubleValue(-80));
+            SetChannelLoss(lossModel);
         }
     }
     else if (frequency == 5)
@@ -548,12 +4702,13 @@ main(int argc, char* argv[])
             lossModel->SetAttribute("Exponent", DoubleValue(3.5));
             lossModel->SetAttribute("ReferenceDistance", DoubleValue(1.0));
             lossModel->SetAttribute("ReferenceLoss", DoubleValue(50));
-            spectrumChannel->AddPropagationLossModel(lossModel);
+            SetChannelLoss(lossModel);
         }
         else if (propagationModel == "fixed")
         {
             Ptr<FixedRssLossModel> lossModel = CreateObject<FixedRssLossModel>();
             lossModel->SetAttribute("Rss", DoubleValue(-80));
+            SetChannelLoss(lossModel);
         }
     }
     else
@@ -566,13 +4721,56 @@ main(int argc, char* argv[])
             lossModel->SetAttribute("Exponent", DoubleValue(2.0));
             lossModel->SetAttribute("ReferenceDistance", DoubleValue(1.0));
             lossModel->SetAttribute("ReferenceLoss", DoubleValue(40.046));
+            SetChannelLoss(lossModel);
         }
         else if (propagationModel == "fixed")
         {
             Ptr<FixedRssLossModel> lossModel = CreateObject<FixedRssLossModel>();
             lossModel->SetAttribute("Rss", DoubleValue(-80));
+            SetChannelLoss(lossModel);
+        }
+    }
+
+    // Both engines get the same loss model, CCA and ED settings; only the channel differs
+    SpectrumWifiPhyHelper spectrumPhy;
+    YansWifiPhyHelper yansPhy;
+    if (phyEngine == "spectrum")
+    {
+        Ptr<MultiModelSpectrumChannel> spectrumChannel =
+            CreateObject<MultiModelSpectrumChannel>();
+        if (channelLoss)
+        {
+            spectrumChannel->AddPropagationLossModel(channelLoss);
+        }
+        if (cullMargin >= 0)
+        {
+            // The channel skips a receiver when the loss exceeds MaxLossDb: it never schedules
+            // the signal arrival, so the PHY does not track it as interference either
+            maxLossDb = txPower - (NoiseFloorDbm() - cullMargin);
+            spectrumChannel->SetAttribute("MaxLossDb", DoubleValue(maxLossDb));
         }
+        spectrumPhy.SetChannel(spectrumChannel);
     }
+    else
+    {
+        // YansWifiChannel dereferences its loss model on every frame
+        NS_ABORT_MSG_IF(!channelLoss, "phyEngine=yans needs a propagation loss model");
+        Ptr<YansWifiChannel> yansChannel = CreateObject<YansWifiChannel>();
+        yansChannel->SetPropagationLossModel(channelLoss);
+        // YansWifiChannel requires a delay model; the spectrum channel has none (zero delay)
+        Ptr<ConstantSpeedPropagationDelayModel> delayModel =
+            CreateObject<ConstantSpeedPropagationDelayModel>();
+        delayModel->SetAttribute("Speed", DoubleValue(std::numeric_limits<double>::max()));
+        yansChannel->SetPropagationDelayModel(delayModel);
+        yansPhy.SetChannel(yansChannel);
+        if (cullMargin >= 0)
+        {
+            std::cout << "WARNING: cullMargin is only applied by the spectrum channel"
+                      << std::endl;
+        }
+    }
+    WifiPhyHelper& phy = (phyEngine == "yans") ? static_cast<WifiPhyHelper&>(yansPhy)
+                                               : static_cast<WifiPhyHelper&>(spectrumPhy);
 
     WifiHelper wifi;
     wifi.SetStandard(wifiStandard);
@@ -582,39 +4780,172 @@ main(int argc, char* argv[])
     }
     else
     {
+        // phyMode=auto sets the DataMode of every station once the nodes are placed
+        std::string mode = (phyMode == "auto") ? "HeMcs0" : phyMode;
         wifi.SetRemoteStationManager("ns3::ConstantRateWifiManager",
                                      "DataMode",
-                                     StringValue(phyMode),
+                                     StringValue(mode),
                                      "ControlMode",
-                                     StringValue(phyMode));
+                                     StringValue(mode));
     }
 
-    SpectrumWifiPhyHelper phy;
     phy.SetErrorRateModel("ns3::TableBasedErrorRateModel");
-
-    phy.SetChannel(spectrumChannel);
     phy.SetPcapDataLinkType(WifiPhyHelper::DLT_IEEE802_11_RADIO);
 
-    if (appType != "setup-done")
+    phy.Set("CcaSensitivity", DoubleValue(ccaSensitivity));
+    // phy.SetPreambleDetectionModel("ns3::ThresholdPreambleDetectionModel",
+    //                               "MinimumRssi",
+    //                               DoubleValue(ccaSensitivity));
+    phy.DisablePreambleDetectionModel();
+
+    phy.Set("TxPowerStart", DoubleValue(txPower));
+    phy.Set("TxPowerEnd", DoubleValue(txPower));
+    // phy.Set("RxSensitivity", DoubleValue(-300));
+    uint64_t beaconInterval = 10 * 1024;
+
+    // Nodes are placed before the devices are installed, so that estimate=only needs no devices
+    for (int i = 0; i < apNodeCount; ++i)
+    {
+        nodeRegistry[apNodes.Get(i)->GetId()].bss = i;
+        nodeRegistry[apNodes.Get(i)->GetId()].isAp = true;
+        wifiNodes.Add(apNodes.Get(i));
+    }
+    for (uint32_t i = 0; i < (apNodeCount * networkSize); ++i)
     {
-        phy.Set("CcaSensitivity", DoubleValue(ccaSensitivity));
-        // phy.SetPreambleDetectionModel("ns3::ThresholdPreambleDetectionModel",
-        //                               "MinimumRssi",
-        //                               DoubleValue(ccaSensitivity));
-        phy.DisablePreambleDetectionModel();
+        nodeRegistry[staNodes.Get(i)->GetId()].bss = i % apNodeCount;
+        wifiNodes.Add(staNodes.Get(i));
+    }
+
+    MobilityHelper mobility;
+    Ptr<ListPositionAllocator> positionAlloc = CreateObject<ListPositionAllocator>();
+    mobility.SetMobilityModel("ns3::ConstantPositionMobilityModel");
+    randomX->SetAttribute("Stream", IntegerValue(seedNumber));
+    randomX->SetAttribute("Max", DoubleValue(distanceAps));
+    randomX->SetAttribute("Min", DoubleValue(0.0));
+
+    randomY->SetAttribute("Stream", IntegerValue(seedNumber + 1));
+    randomY->SetAttribute("Max", DoubleValue(distanceAps));
+    randomY->SetAttribute("Min", DoubleValue(0.0));
+
+    randomAngle->SetAttribute("Stream", IntegerValue(seedNumber + 2));
+    randomAngle->SetAttribute("Max", DoubleValue(360));
+    randomAngle->SetAttribute("Min", DoubleValue(0.0));
 
-        phy.Set("TxPowerStart", DoubleValue(txPower));
-        phy.Set("TxPowerEnd", DoubleValue(txPower));
-        // phy.Set("RxSensitivity", DoubleValue(-300));
+    std::vector<Point> apPositions = PlaceAps(apNodes.GetN());
+    std::vector<Vector> nodePositions(NodeList::GetNNodes());
+    std::ofstream outFile("points.txt");
+    for (uint32_t i = 0; i < apNodes.GetN(); i++)
+    {
+        Vector l1(apPositions[i].x, apPositions[i].y, 1.5);
+        positionAlloc->Add(l1);
+        nodePositions[apNodes.Get(i)->GetId()] = l1;
+        outFile << "AP" << apNodes.Get(i)->GetId() << " " << apPositions[i].x << ","
+                << apPositions[i].y << std::endl;
+    }
+
+    // Set position for STAs
+    std::vector<Vector> ringPos;
+    std::vector<Vector> ringPosInv;
+    if (topology == "disc-random")
+    {
+        for (uint32_t i = 0; i < staNodes.GetN(); i++)
+        {
+            double currentAp = nodeRegistry[staNodes.Get(i)->GetId()].bss;
+            Point apPos = apPositions[currentAp];
+            Point staPos = generateRandomPointInCircle(radius, apPos);
+            Vector l1(staPos.x, staPos.y, 1.5);
+            positionAlloc->Add(l1);
+            nodePositions[staNodes.Get(i)->GetId()] = l1;
+            outFile << "STA" << staNodes.Get(i)->GetId() << " " << staPos.x << "," << staPos.y
+                    << std::endl;
+        }
+    }
+    else if (topology == "disc")
+    {
+        for (uint32_t i = 0; i < staNodes.GetN(); i++)
+        {
+            double currentAp = nodeRegistry[staNodes.Get(i)->GetId()].bss;
+            Point apPos = apPositions[currentAp];
+
+            // Spread the STAs of each BSS evenly around their AP (STA i is the
+            // (i / apNodeCount)-th STA of its BSS)
+            double angleIncrement = 2 * M_PI / networkSize; // Divide the circle into equal parts
+            double currentAngle = (i / apNodeCount) * angleIncrement;
+
+            // Calculate the position on the circle's perimeter using the angle
+            Point staPos;
+            staPos.x = apPos.x + radius * cos(currentAngle);
+            staPos.y = apPos.y + radius * sin(currentAngle);
+
+            Vector l1(staPos.x, staPos.y, 1.5);
+            positionAlloc->Add(l1);
+            nodePositions[staNodes.Get(i)->GetId()] = l1;
+            outFile << "STA" << staNodes.Get(i)->GetId() << " " << staPos.x << "," << staPos.y
+                    << std::endl;
+        }
+    }
+
+    outFile << "radius " << radius << std::endl;
+
+    if (appType == "setup-done")
+    {
+        // Use the exact positions the snapshot was taken with
+        positionAlloc = CreateObject<ListPositionAllocator>();
+        for (uint32_t i = 0; i < wifiNodes.GetN(); i++)
+        {
+            positionAlloc->Add(snapshot.positions.at(wifiNodes.Get(i)->GetId()));
+            nodePositions[wifiNodes.Get(i)->GetId()] =
+                snapshot.positions.at(wifiNodes.Get(i)->GetId());
+        }
+    }
+    spatialIndex.Build(nodePositions, std::max<double>(distanceAps, 1));
+
+    mobility.SetPositionAllocator(positionAlloc);
+    mobility.Install(wifiNodes);
+    if (lossMatrix)
+    {
+        lossMatrix->Build(wifiNodes);
+    }
+    if (cullMargin >= 0 && channelLoss && phyEngine == "spectrum")
+    {
+        PrintCulling();
+    }
+
+    std::vector<WifiMode> modes;
+    for (uint8_t mcs = 0; mcs < 12; mcs++)
+    {
+        modes.push_back(WifiMode("HeMcs" + std::to_string(mcs)));
+    }
+    if (phyMode == "auto")
+    {
+        // without a loss model every link would look lossless and pick the top MCS
+        NS_ABORT_MSG_IF(!channelLoss, "phyMode=auto needs a propagation loss model");
+        SelectAutoMcs(modes);
+    }
+
+    std::vector<double> estimate;
+    if (estimateMode != "off")
+    {
+        estimate = EstimateBssThroughput();
+    }
+    if (estimateMode == "only")
+    {
+        // The estimate only needs the placed nodes, the devices are never installed
+        PrintEstimate(estimate, {});
+        TrialResult result;
+        result.associatedStas = staNodes.GetN();
+        result.throughput = std::accumulate(estimate.begin(), estimate.end(), 0.0);
+        result.fairness = JainIndex(estimate);
+        result.bssThroughput = estimate;
+        Simulator::Destroy();
+        return result;
     }
-    uint64_t beaconInterval = 10 * 1024;
 
     WifiMacHelper mac;
     for (int i = 0; i < apNodeCount; ++i)
     {
         std::string ssi = "BSS-" + std::to_string(i);
         Ssid ssid = Ssid(ssi);
-        bssNode[apNodes.Get(i)->GetId()] = i;
         mac.SetType("ns3::ApWifiMac",
                     "BeaconInterval",
                     TimeValue(MicroSeconds(beaconInterval)),
@@ -625,7 +4956,6 @@ main(int argc, char* argv[])
 
         apDevices.Add(tmp.Get(0));
         devices.Add(tmp.Get(0));
-        wifiNodes.Add(apNodes.Get(i));
         std::cout << "AP MAC: " << tmp.Get(0)->GetAddress() << "," << ssi << std::endl;
     }
 
@@ -635,21 +4965,34 @@ main(int argc, char* argv[])
         // correct SSID
         std::string ssi = "BSS-" + std::to_string(i % apNodeCount);
         Ssid ssid = Ssid(ssi);
-        bssNode[staNodes.Get(i)->GetId()] = i % apNodeCount;
         mac.SetType("ns3::StaWifiMac",
                     "MaxMissedBeacons",
                     UintegerValue(std::numeric_limits<uint32_t>::max()),
                     "Ssid",
                     SsidValue(ssid));
+        if (appType == "setup-done" || preassociate)
+        {
+            // Go straight to the AP this STA associated with when the snapshot was taken, or
+            // to the AP of its BSS
+            uint32_t bss = i % apNodeCount;
+            if (appType == "setup-done")
+            {
+                bss = nodeRegistry[snapshot.staAp.at(staNodes.Get(i)->GetId())].bss;
+            }
+            Address bssid = apDevices.Get(bss)->GetAddress();
+            mac.SetAssocManager("ns3::PinnedAssocManager",
+                                "Bssid",
+                                Mac48AddressValue(Mac48Address::ConvertFrom(bssid)));
+        }
         NetDeviceContainer tmp = wifi.Install(phy, mac, staNodes.Get(i));
 
         devices.Add(tmp.Get(0));
         staDevices.Add(tmp.Get(0));
-        wifiNodes.Add(staNodes.Get(i));
         std::cout << "STA: " << i << std::endl;
         std::cout << "STA MAC: " << tmp.Get(0)->GetAddress() << "," << ssi << std::endl;
     }
-    wifi.AssignStreams(devices, 0);
+    // Streams [0, appStreamBase) drive the PHYs and MACs, the traffic sources use the next ones
+    int64_t appStreamBase = wifi.AssignStreams(devices, 0);
 
     // Set guard interval
     Config::Set("/NodeList/*/DeviceList/*/$ns3::WifiNetDevice/HeConfiguration/"
@@ -676,145 +5019,79 @@ main(int argc, char* argv[])
         wifi_dev->GetMac()->SetAttribute("VI_MaxAmpduSize",
                                          UintegerValue(maxMpdus * (packetSize + 50)));
 
-        // count associations
-        wifi_dev->GetMac()->TraceConnectWithoutContext("AssociatedSta",
-                                                       MakeCallback(&AssociatedSta));
-        // count Desassociations
-        wifi_dev->GetMac()->TraceConnectWithoutContext("DeAssociatedSta",
-                                                       MakeCallback(&DeAssociatedSta));
-    }
-    // Configure STA aggregation
-    for (uint32_t i = 0; i < (apNodeCount * networkSize); ++i)
-    {
-        Ptr<NetDevice> dev = staNodes.Get(i)->GetDevice(0);
-
-        Ptr<WifiNetDevice> wifi_dev = DynamicCast<WifiNetDevice>(dev);
-        wifi_dev->GetVhtConfiguration()->SetSecondaryCcaSensitivityThresholds(edThresholds);
-        Ptr<HeConfiguration> heConfiguration = wifi_dev->GetHeConfiguration();
-
-        wifi_dev->GetMac()->SetAttribute("BE_MaxAmpduSize",
-                                         UintegerValue(maxMpdus * (packetSize + 50)));
-        wifi_dev->GetMac()->SetAttribute("BK_MaxAmpduSize",
-                                         UintegerValue(maxMpdus * (packetSize + 50)));
-        wifi_dev->GetMac()->SetAttribute("VO_MaxAmpduSize",
-                                         UintegerValue(maxMpdus * (packetSize + 50)));
-        wifi_dev->GetMac()->SetAttribute("VI_MaxAmpduSize",
-                                         UintegerValue(maxMpdus * (packetSize + 50)));
-    }
-
-    MobilityHelper mobility;
-    Ptr<ListPositionAllocator> positionAlloc = CreateObject<ListPositionAllocator>();
-    mobility.SetMobilityModel("ns3::ConstantPositionMobilityModel");
-    randomX->SetAttribute("Stream", IntegerValue(seedNumber));
-    randomX->SetAttribute("Max", DoubleValue(distanceAps));
-    randomX->SetAttribute("Min", DoubleValue(0.0));
-
-    randomY->SetAttribute("Stream", IntegerValue(seedNumber + 1));
-    randomY->SetAttribute("Max", DoubleValue(distanceAps));
-    randomY->SetAttribute("Min", DoubleValue(0.0));
-
-    randomAngle->SetAttribute("Stream", IntegerValue(seedNumber + 2));
-    randomAngle->SetAttribute("Max", DoubleValue(360));
-    randomAngle->SetAttribute("Min", DoubleValue(0.0));
-
-    std::vector<Point> apPositions;
-    std::ofstream outFile("points.txt");
-    for (uint32_t i = 0; i < apNodes.GetN(); i++)
-    {
-        double x = (distanceAps / 2.0);
-        double y = (distanceAps / 2.0);
-        if (i == 1)
-        {
-            x = (distanceAps / 2.0) + (distanceAps);
-        }
-        if (i == 2)
-        {
-            x = (distanceAps / 2.0);
-            y = (distanceAps / 2.0) + (distanceAps);
-        }
-        else if (i == 3)
-        {
-            x = (distanceAps / 2.0) + (distanceAps);
-            y = (distanceAps / 2.0) + (distanceAps);
-        }
-        Vector l1(x, y, 1.5);
-        positionAlloc->Add(l1);
-        Point apPos;
-        apPos.x = x;
-        apPos.y = y;
-        apPositions.push_back(apPos);
-        outFile << "AP" << apNodes.Get(i)->GetId() << " " << x << "," << y << std::endl;
-    }
-
-    // Set position for STAs
-    std::vector<Vector> ringPos;
-    std::vector<Vector> ringPosInv;
-    if (topology == "disc-random")
-    {
-        for (uint32_t i = 0; i < staNodes.GetN(); i++)
-        {
-            double currentAp = bssNode[staNodes.Get(i)->GetId()];
-            Point apPos = apPositions[currentAp];
-            Point staPos = generateRandomPointInCircle(radius, apPos);
-            Vector l1(staPos.x, staPos.y, 1.5);
-            positionAlloc->Add(l1);
-            outFile << "STA" << staNodes.Get(i)->GetId() << " " << staPos.x << "," << staPos.y
-                    << std::endl;
-        }
+        // count associations
+        wifi_dev->GetMac()->TraceConnectWithoutContext(
+            "AssociatedSta",
+            MakeBoundCallback(&AssociatedSta, apNodes.Get(i)->GetId()));
+        // count Desassociations
+        wifi_dev->GetMac()->TraceConnectWithoutContext("DeAssociatedSta",
+                                                       MakeCallback(&DeAssociatedSta));
     }
-    else if (topology == "disc")
+    // Configure STA aggregation
+    for (uint32_t i = 0; i < (apNodeCount * networkSize); ++i)
     {
-        for (uint32_t i = 0; i < staNodes.GetN(); i++)
-        {
-            double currentAp = bssNode[staNodes.Get(i)->GetId()];
-            Point apPos = apPositions[currentAp];
-
-            // Calculate the angle for the current point to ensure even distribution
-            double angleIncrement =
-                2 * M_PI / staNodes.GetN();           // Divide the circle into equal parts
-            double currentAngle = i * angleIncrement; // Current angle for this station
+        Ptr<NetDevice> dev = staNodes.Get(i)->GetDevice(0);
 
-            // Calculate the position on the circle's perimeter using the angle
-            Point staPos;
-            staPos.x = apPos.x + radius * cos(currentAngle);
-            staPos.y = apPos.y + radius * sin(currentAngle);
+        Ptr<WifiNetDevice> wifi_dev = DynamicCast<WifiNetDevice>(dev);
+        wifi_dev->GetVhtConfiguration()->SetSecondaryCcaSensitivityThresholds(edThresholds);
+        Ptr<HeConfiguration> heConfiguration = wifi_dev->GetHeConfiguration();
 
-            Vector l1(staPos.x, staPos.y, 1.5);
-            positionAlloc->Add(l1);
-            outFile << "STA" << staNodes.Get(i)->GetId() << " " << staPos.x << "," << staPos.y
-                    << std::endl;
-        }
+        wifi_dev->GetMac()->SetAttribute("BE_MaxAmpduSize",
+                                         UintegerValue(maxMpdus * (packetSize + 50)));
+        wifi_dev->GetMac()->SetAttribute("BK_MaxAmpduSize",
+                                         UintegerValue(maxMpdus * (packetSize + 50)));
+        wifi_dev->GetMac()->SetAttribute("VO_MaxAmpduSize",
+                                         UintegerValue(maxMpdus * (packetSize + 50)));
+        wifi_dev->GetMac()->SetAttribute("VI_MaxAmpduSize",
+                                         UintegerValue(maxMpdus * (packetSize + 50)));
     }
 
-    outFile << "radius " << radius << std::endl;
-
-    mobility.SetPositionAllocator(positionAlloc);
-    mobility.Install(wifiNodes);
-
-    std::vector<WifiMode> modes;
-    for (uint8_t mcs = 0; mcs < 12; mcs++)
+    if (phyMode == "auto")
     {
-        modes.push_back(WifiMode("HeMcs" + std::to_string(mcs)));
+        ConfigureAutoMcs(modes);
     }
 
-    if (appType == "constant")
+    if (appType == "constant" || appType == "setup-done" || appType == "bursty" ||
+        appType == "bursty-trace" || appType == "poisson")
     {
-        PacketSocketHelper packetSocket;
-        packetSocket.Install(wifiNodes);
+        if (payload == "socket")
+        {
+            PacketSocketHelper packetSocket;
+            packetSocket.Install(wifiNodes);
+        }
 
         ApplicationContainer apps;
         Ptr<UniformRandomVariable> startTime = CreateObject<UniformRandomVariable>();
 
         startTime->SetAttribute("Stream", IntegerValue(0));
-        startTime->SetAttribute("Min", DoubleValue(6));
-        startTime->SetAttribute("Max", DoubleValue(8));
+        startTime->SetAttribute("Min", DoubleValue(0.6 * warmup));
+        startTime->SetAttribute("Max", DoubleValue(0.8 * warmup));
+
+        bssCounters.assign(apNodeCount, BssCounters());
+        for (uint32_t i = 0; i < staDevices.GetN(); i++)
+        {
+            DynamicCast<WifiNetDevice>(staDevices.Get(i))
+                ->GetPhy()
+                ->TraceConnectWithoutContext(
+                    "PhyTxPsduBegin",
+                    MakeBoundCallback(&BssPhyTx, staDevices.Get(i)->GetNode()->GetId()));
+        }
 
         double start = 0;
         for (int i = 0; i < apNodeCount; i++)
         {
             Ptr<WifiNetDevice> wifi_apDev = DynamicCast<WifiNetDevice>(apDevices.Get(i));
             Ptr<ApWifiMac> ap_mac = DynamicCast<ApWifiMac>(wifi_apDev->GetMac());
-            Ptr<PacketSocketServer> server = CreateObject<PacketSocketServer>();
+            Ptr<PacketSocketServer> server;
+            if (payload == "socket")
+            {
+                server = CreateObject<PacketSocketServer>();
+                server->TraceConnectWithoutContext("Rx",
+                                                   MakeBoundCallback(&BssServerRx, uint32_t(i)));
+            }
+            wifi_apDev->GetPhy()->TraceConnectWithoutContext(
+                "MonitorSnifferRx",
+                MakeBoundCallback(&BssPhyRx, apNodes.Get(i)->GetId()));
 
             for (uint32_t x = 0; x < staNodes.GetN(); x += apNodeCount)
             {
@@ -826,71 +5103,664 @@ main(int argc, char* argv[])
                 socketAddr.SetSingleDevice(staDevices.Get((x + i))->GetIfIndex());
                 socketAddr.SetPhysicalAddress(apDevices.Get(i)->GetAddress());
                 socketAddr.SetProtocol(1);
+                if (payload == "socket")
+                {
+                    // the bursty sources send to the same protocol number without a socket
+                    server->SetLocal(socketAddr);
+                }
 
-                Ptr<PacketSocketClient> client = CreateObject<PacketSocketClient>();
-                client->SetRemote(socketAddr);
+                Ptr<Application> client;
+                if (appType == "bursty")
+                {
+                    Ptr<BurstyClient> burstyClient = CreateObject<BurstyClient>();
+                    burstyClient->SetRemote(staDevices.Get(x + i),
+                                            apDevices.Get(i)->GetAddress(),
+                                            1);
+                    burstyClient->SetAttribute("OnTime", TimeValue(MilliSeconds(burstOn)));
+                    burstyClient->SetAttribute("OffTime", TimeValue(MilliSeconds(burstOff)));
+                    burstyClient->SetStream(appStreamBase + x + i);
+                    client = burstyClient;
+                }
+                else if (appType == "poisson")
+                {
+                    Ptr<PoissonClient> poissonClient = CreateObject<PoissonClient>();
+                    poissonClient->SetRemote(staDevices.Get(x + i),
+                                             apDevices.Get(i)->GetAddress(),
+                                             1);
+                    poissonClient->SetAttribute("MeanInterval",
+                                                TimeValue(Seconds(1e-6 / trafficArrivalRate)));
+                    poissonClient->SetStream(appStreamBase + x + i);
+                    client = poissonClient;
+                }
+                else if (appType == "bursty-trace")
+                {
+                    std::string path = trafficTrace;
+                    std::size_t at = path.find("{sta}");
+                    if (at != std::string::npos)
+                    {
+                        path.replace(at, 5, std::to_string(x + i));
+                    }
+                    Ptr<TraceReplayClient> traceClient = CreateObject<TraceReplayClient>();
+                    traceClient->SetRemote(staDevices.Get(x + i),
+                                           apDevices.Get(i)->GetAddress(),
+                                           1);
+                    traceClient->SetAttribute("TraceFile", StringValue(path));
+                    traceClient->SetAttribute("Window", TimeValue(Seconds(traceWindow)));
+                    client = traceClient;
+                }
+                else if (payload == "virtual")
+                {
+                    Ptr<VirtualPayloadClient> virtualClient =
+                        CreateObject<VirtualPayloadClient>();
+                    virtualClient->SetRemote(staDevices.Get(x + i),
+                                             apDevices.Get(i)->GetAddress(),
+                                             1);
+                    client = virtualClient;
+                }
+                else
+                {
+                    Ptr<PacketSocketClient> socketClient = CreateObject<PacketSocketClient>();
+                    socketClient->SetRemote(socketAddr);
+                    socketClient->SetAttribute("MaxPackets", UintegerValue(0));
+                    client = socketClient;
+                }
 
                 staNodes.Get(x + i)->AddApplication(client);
-                client->SetAttribute("PacketSize", UintegerValue(packetSize));
-                client->SetAttribute("MaxPackets", UintegerValue(0));
-                client->SetAttribute("Interval", TimeValue(Time(MicroSeconds(pktInterval))));
+                if (appType == "poisson")
+                {
+                    client->SetAttribute("PacketSize", UintegerValue(packetSize));
+                }
+                else if (appType != "bursty-trace")
+                {
+                    client->SetAttribute("PacketSize", UintegerValue(packetSize));
+                    client->SetAttribute("Interval", TimeValue(Time(MicroSeconds(pktInterval))));
+                }
                 start = startTime->GetValue();
                 client->SetStartTime(Seconds(start));
                 std::cout << "APP START: " << start << std::endl;
-
-                server->SetLocal(socketAddr);
             }
-            apNodes.Get(i)->AddApplication(server);
+            if (payload == "virtual")
+            {
+                apNodes.Get(i)->RegisterProtocolHandler(
+                    MakeBoundCallback(&BssVirtualRx, uint32_t(i)),
+                    1,
+                    apDevices.Get(i));
+            }
+            else
+            {
+                apNodes.Get(i)->AddApplication(server);
+            }
         }
     }
 
-    // populate m_staMacAddressToNodeId map
-    for (auto it = staDevices.Begin(); it != staDevices.End(); it++)
+    // populate the MAC table and the devices of the node registry
+    macToNodeId.Reserve(devices.GetN());
+    for (auto it = devices.Begin(); it != devices.End(); it++)
     {
-        m_staMacAddressToNodeId[Mac48Address::ConvertFrom((*it)->GetAddress())] =
-            (*it)->GetNode()->GetId();
+        uint32_t nodeId = (*it)->GetNode()->GetId();
+        nodeRegistry[nodeId].device = DynamicCast<WifiNetDevice>(*it);
+        macToNodeId.Insert(MacToInteger(Mac48Address::ConvertFrom((*it)->GetAddress())), nodeId);
     }
 
     if (phyMode != "auto")
     {
         for (size_t i = 0; i < wifiNodes.GetN(); i++)
         {
-            nodeMcs[wifiNodes.Get(i)->GetId()] = mcs;
+            nodeRegistry[wifiNodes.Get(i)->GetId()].mcs = mcs;
         }
     }
 
     if (enablePhyTraceHelper)
     {
-        wifiStats.Enable(wifiNodes);
-        wifiStats.Start(Seconds(10));
-        wifiStats.Stop(Seconds((10) + duration));
-        Simulator::Schedule(Seconds((10) + duration), &CheckStats);
+        std::string suffix = replications > 1 ? "-r" + std::to_string(replication) : "";
+        if (phyTraceMode == "aggregate")
+        {
+            EnableRxAggregate(wifiNodes, "rx-matrix" + suffix + ".txt");
+        }
+        else
+        {
+            wifiStats.Enable(wifiNodes);
+            wifiStats.Start(Seconds(warmup));
+            wifiStats.Stop(Seconds(warmup + duration));
+        }
+        NS_ABORT_MSG_IF(timelineFormat != "csv" && timelineFormat != "binary",
+                        "Unsupported timeline format " << timelineFormat);
+        bool binary = (timelineFormat == "binary");
+        timelineWriter.Open("tx-timeline" + suffix + (binary ? ".bin" : ".txt"), binary);
+        Simulator::Schedule(Seconds(warmup + timelineFlush), &ScheduleTimelineDrain);
+        checkStatsEvent = Simulator::Schedule(Seconds(warmup + duration), &CheckStats);
+    }
+
+    if (!telemetryFile.empty())
+    {
+        EnableTelemetry(ReplicationPath(telemetryFile, replication));
+    }
+    if (!occupancyFile.empty())
+    {
+        EnableOccupancy(wifiNodes, apNodeCount, ReplicationPath(occupancyFile, replication));
+    }
+
+    if (ciTarget > 0 && !bssCounters.empty())
+    {
+        bssBatches.assign(bssCounters.size(), BatchMeans());
+        Simulator::Schedule(Seconds(warmup + ciBatch), &EndBatch);
+    }
+
+    if (preassociate)
+    {
+        // Associations trigger the check themselves when the last STA is associated
+        Simulator::Schedule(Seconds(warmup), &WarnUnassociated);
+    }
+    else
+    {
+        // Restored associations trigger the check themselves, this is only the fallback
+        checkAssociationEvent = Simulator::Schedule(
+            Seconds(appType == "setup-done" ? warmup : 1.5),
+            &CheckAssociation);
     }
 
-    Simulator::Schedule(Seconds(1.5), &CheckAssociation);
+    if (bench)
+    {
+        Simulator::Schedule(Seconds(warmup), &MarkMeasurementStart);
+    }
 
-    Simulator::Stop(Seconds((10) + duration));
+    Simulator::Stop(Seconds(warmup + duration));
+    benchClock.run = BenchClock::Clock::now();
     Simulator::Run();
+    if (profiling)
+    {
+        ProfileRunEnd();
+    }
+    benchClock.end = BenchClock::Clock::now();
+    // CheckStats closes the timeline at the end of the measurement window, runs stopped before
+    // it (app=setup) still have to join the writer thread
+    timelineWriter.Close();
+    telemetryWriter.Close();
+    if (!occupancy.path.empty())
+    {
+        WriteOccupancy();
+    }
+
+    if (bench)
+    {
+        PrintBench();
+    }
+
+    TrialResult result = CollectTrialResult();
+    if (!bssCounters.empty())
+    {
+        PrintBssStatistics();
+    }
+    if (estimateMode == "check")
+    {
+        PrintEstimate(estimate, result.bssThroughput);
+    }
 
     Simulator::Destroy();
-    return 0;
+    return result;
+}
+
+/// Run replications first, ..., first + count - 1 and append their results
+void
+RunReplications(uint32_t first, uint32_t count, std::vector<TrialResult>& results)
+{
+    for (uint32_t replication = first; replication < first + count; replication++)
+    {
+        duration = durationCap; // --ciTarget shortens it when a trial stops early
+        results.push_back(RunTrial(replication));
+    }
+}
+
+/*
+ * CCA sensitivity search (--optimize)
+ *
+ * Golden-section search of the ccaSensitivity that maximizes the aggregate throughput
+ * (throughput) or the aggregate throughput times the Jain fairness index (fair) over
+ * [optimizeMin, optimizeMax], down to an interval of optimizeTolerance dB. The objective is
+ * assumed unimodal in the CCA threshold. Every sampled threshold runs the same RNG runs
+ * (seedNumber, seedNumber + 1, ...), so two samples differ by the threshold and not by the
+ * seeds. When the 95% CIs of the two points being compared overlap, both get replications
+ * more runs, up to optimizeMaxReplications, before the interval is narrowed.
+ */
+
+std::string optimize("off");          ///< off, throughput or fair
+double optimizeMin = -82;             ///< Lower end of the searched CCA range (dBm)
+double optimizeMax = -62;             ///< Upper end of the searched CCA range (dBm)
+double optimizeTolerance = 1;         ///< Width of the final interval (dB)
+uint32_t optimizeMaxReplications = 8; ///< Replications at which a comparison is decided anyway
+
+/// Objective of the search for one trial
+double
+CcaObjective(const TrialResult& result)
+{
+    return optimize == "fair" ? result.throughput * result.fairness : result.throughput;
+}
+
+/// Trials run at one CCA threshold
+struct CcaSample
+{
+    std::vector<TrialResult> results; ///< One per replication, in RNG run order
+
+    std::pair<double, double> Objective() const
+    {
+        return MeanCi(Collect(results, CcaObjective));
+    }
+};
+
+/// Trials at a CCA threshold, running the first replications if it was not sampled yet
+CcaSample&
+SampleCca(std::map<double, CcaSample>& samples, double cca)
+{
+    cca = std::round(cca * 100) / 100; // so that the reused golden-section point is found
+    CcaSample& sample = samples[cca];
+    if (sample.results.empty())
+    {
+        std::cout << "CCA search: sampling " << cca << " dBm" << std::endl;
+        ccaSensitivity = cca;
+        RunReplications(0, replications, sample.results);
+    }
+    return sample;
+}
+
+/// Whether a is better than b, adding replications to both while their CIs overlap
+bool
+CcaBetter(std::map<double, CcaSample>& samples, double a, double b)
+{
+    CcaSample& sampleA = SampleCca(samples, a);
+    CcaSample& sampleB = SampleCca(samples, b);
+    while (true)
+    {
+        auto [meanA, ciA] = sampleA.Objective();
+        auto [meanB, ciB] = sampleB.Objective();
+        uint32_t n = std::min(sampleA.results.size(), sampleB.results.size());
+        if (std::abs(meanA - meanB) > ciA + ciB || n + replications > optimizeMaxReplications ||
+            (n > 1 && ciA + ciB == 0))
+        {
+            return meanA > meanB;
+        }
+        std::cout << "CCA search: " << a << " and " << b << " dBm overlap, running "
+                  << replications << " more replications" << std::endl;
+        for (auto [cca, sample] : {std::make_pair(a, &sampleA), std::make_pair(b, &sampleB)})
+        {
+            ccaSensitivity = std::round(cca * 100) / 100;
+            RunReplications(sample->results.size(), replications, sample->results);
+        }
+    }
+}
+
+/// Golden-section search of the best CCA threshold; returns the samples taken
+std::map<double, CcaSample>
+SearchCca()
+{
+    const double ratio = (std::sqrt(5.0) - 1) / 2;
+    std::map<double, CcaSample> samples;
+    double low = optimizeMin;
+    double high = optimizeMax;
+    double left = high - ratio * (high - low);
+    double right = low + ratio * (high - low);
+    while (high - low > optimizeTolerance)
+    {
+        if (CcaBetter(samples, left, right))
+        {
+            high = right;
+            right = left;
+            left = high - ratio * (high - low);
+        }
+        else
+        {
+            low = left;
+            left = right;
+            right = low + ratio * (high - low);
+        }
+    }
+    return samples;
+}
+
+/// Print every sample and the best one, whose results become those of the run
+std::vector<TrialResult>
+ReportCcaSearch(const std::map<double, CcaSample>& samples)
+{
+    uint32_t trials = 0;
+    auto best = samples.begin();
+    for (auto it = samples.begin(); it != samples.end(); it++)
+    {
+        auto [objective, ci] = it->second.Objective();
+        const auto& results = it->second.results;
+        trials += results.size();
+        std::cout << "CCA sample: " << it->first << " dBm, objective " << objective << " +- "
+                  << ci << ", throughput "
+                  << MeanCi(Collect(results, [](const TrialResult& r) { return r.throughput; }))
+                         .first
+                  << " Mbps, fairness "
+                  << MeanCi(Collect(results, [](const TrialResult& r) { return r.fairness; }))
+                         .first
+                  << ", replications " << results.size() << std::endl;
+        if (objective > best->second.Objective().first)
+        {
+            best = it;
+        }
+    }
+    std::cout << "CCA optimum: " << best->first << " dBm (" << optimize << " objective "
+              << best->second.Objective().first << "), " << samples.size() << " thresholds, "
+              << trials << " trials" << std::endl;
+    ccaSensitivity = best->first;
+    return best->second.results;
 }
 
+int
+main(int argc, char* argv[])
+{
+    benchClock.start = BenchClock::Clock::now();
+
+    // Disable fragmentation and RTS/CTS
+    Config::SetDefault("ns3::WifiRemoteStationManager::FragmentationThreshold",
+                       StringValue("22000"));
+    Config::SetDefault("ns3::WifiRemoteStationManager::RtsCtsThreshold", StringValue("22000"));
+    // Disable short retransmission failure (make retransmissions persistent)
+    Config::SetDefault("ns3::WifiRemoteStationManager::MaxSlrc",
+                       UintegerValue(std::numeric_limits<uint32_t>::max()));
+    Config::SetDefault("ns3::WifiRemoteStationManager::MaxSsrc",
+                       UintegerValue(std::numeric_limits<uint32_t>::max()));
+    // Set maximum queue size to the largest value and set maximum queue delay to be larger
+    // than the simulation time
+    Config::SetDefault("ns3::WifiMacQueue::MaxSize",
+                       QueueSizeValue(QueueSize(QueueSizeUnit::PACKETS,
+                                                100))); // TODO: set to a smaller value. 100?
+    Config::SetDefault("ns3::WifiMacQueue::MaxDelay", TimeValue(Seconds(20 * duration)));
+
+    RecordingCommandLine cmd(__FILE__);
+    cmd.AddValue("pktSize", "The packet size in bytes", packetSize);
+    cmd.AddValue("ed", "edThreshold for all secondary channels", edThreshold);
+    cmd.AddValue("rng", "The seed run number", seedNumber);
+    cmd.AddValue("rngRun", "Same as rng", seedNumber);
+    cmd.AddValue("replications",
+                 "Number of runs (rng, rng + 1, ...) done one after the other in this process",
+                 replications);
+    cmd.AddValue("app",
+                 "The type of application to set. (constant,bursty,bursty-trace,setup,setup-done)",
+                 appType);
+    cmd.AddValue("burstOn", "Mean on period of the bursty sources (ms)", burstOn);
+    cmd.AddValue("burstOff", "Mean off period of the bursty sources (ms)", burstOff);
+    cmd.AddValue("trafficTrace",
+                 "Packet trace replayed by every STA with app=bursty-trace, one \"<time (s)> "
+                 "<size (bytes)>\" per line; {sta} in the name is replaced by the STA index",
+                 trafficTrace);
+    cmd.AddValue("traceWindow",
+                 "Seconds of the traffic traces scheduled at a time with app=bursty-trace",
+                 traceWindow);
+    cmd.AddValue("trafficArrivalRate",
+                 "Poisson packet arrivals per microsecond of every STA (lambda); turns "
+                 "app=constant into app=poisson",
+                 trafficArrivalRate);
+    cmd.AddValue("arrivalOutput",
+                 "File the lambda, throughput and fairness of app=poisson runs are appended to",
+                 arrivalOutput);
+
+    cmd.AddValue("topology", "The topology to use.", topology);
+    cmd.AddValue("apLayout", "AP placement: grid, hex or poisson", apLayout);
+    cmd.AddValue("prop", "The propagation loss model", propagationModel);
+    cmd.AddValue("distanceAps", "Set the size of the box in meters", distanceAps);
+    cmd.AddValue("radius", "Set the radius in meters between the AP and the STAs", radius);
+    cmd.AddValue("ccaSensitivity", "The cca sensitivity (-82dBm)", ccaSensitivity);
+    cmd.AddValue("ccaPdThreshold", "Same as ccaSensitivity", ccaSensitivity);
+    cmd.AddValue("duration", "Time duration for each trial in seconds", duration);
+    cmd.AddValue("networkSize", "Number of stations per bss", networkSize);
+    cmd.AddValue("standard", "Set the standard (11a, 11b, 11g, 11n, 11ac, 11ax)", standard);
+    cmd.AddValue("apNodes", "Number of APs", apNodeCount);
+    cmd.AddValue("numBSS", "Same as apNodes", apNodeCount);
+    cmd.AddValue("phyMode",
+                 "Set the constant PHY mode string used to transmit frames (auto: per station "
+                 "from the SNR of its link, ideal: IdealWifiManager)",
+                 phyMode);
+    cmd.AddValue("autoTargetPer",
+                 "Highest PER of the MCS chosen for a link with phyMode=auto",
+                 autoTargetPer);
+    cmd.AddValue("frequency", "Set the operating frequency band in GHz: 2.4, 5 or 6", frequency);
+    cmd.AddValue("channelWidth",
+                 "Set the constant channel width in MHz (only for 11n/ac/ax)",
+                 channelWidth);
+    cmd.AddValue("gi",
+                 "Set the the guard interval in nanoseconds (800 or 400 for 11n/ac, 800 or 1600 or "
+                 "3200 for 11 ax)",
+                 gi);
+    cmd.AddValue("maxMpdus",
+                 "Set the maximum number of MPDUs in A-MPDUs (0 to disable MPDU aggregation)",
+                 maxMpdus);
+    cmd.AddValue("txPower", "Set the transmit power of all nodes in dBm", txPower);
+    cmd.AddValue("pktInterval", "Set the socket packet interval in microseconds", pktInterval);
+    cmd.AddValue("enablePhyTraceHelper", "Enable BSS Color", enablePhyTraceHelper);
+    cmd.AddValue("timelineFlush",
+                 "Simulated seconds between two writes of PHY trace records to the timeline",
+                 timelineFlush);
+    cmd.AddValue("phyTraceMode",
+                 "PHY trace with enablePhyTraceHelper: records (one per PPDU and receiver, in the "
+                 "timeline) or aggregate (per sender/receiver counters in rx-matrix.txt)",
+                 phyTraceMode);
+    cmd.AddValue("phyTraceSample",
+                 "Fraction of the receptions also written to the timeline with "
+                 "phyTraceMode=aggregate",
+                 phyTraceSample);
+    cmd.AddValue("telemetry",
+                 "Binary file of CW, backoff, queue depth and BSS throughput samples of every node "
+                 "(empty: disabled)",
+                 telemetryFile);
+    cmd.AddValue("telemetryPeriod",
+                 "Simulated seconds between two telemetry samples",
+                 telemetryPeriod);
+    cmd.AddValue("telemetryCapacity",
+                 "Telemetry samples buffered per node before new ones are dropped",
+                 telemetryCapacity);
+    cmd.AddValue("occupancy",
+                 "File of the idle, CCA busy, Tx, Rx and OBSS Rx airtime of every node and BSS, "
+                 "and of the time BSSs were on air together (empty: disabled)",
+                 occupancyFile);
+    cmd.AddValue("timelineFormat",
+                 "PHY trace timeline format: csv (tx-timeline.txt) or binary (tx-timeline.bin)",
+                 timelineFormat);
+    cmd.AddValue("warmup",
+                 "Simulated seconds before measurement starts (-1: 10, 0.5 with setup-done, 0.1 "
+                 "with preassociate)",
+                 warmup);
+    cmd.AddValue("preassociate",
+                 "Associate every STA directly with the AP of its BSS, without scanning",
+                 preassociate);
+    cmd.AddValue("phyEngine",
+                 "PHY and channel models: spectrum, or yans (single 20 MHz channel only)",
+                 phyEngine);
+    cmd.AddValue("payload",
+                 "Uplink packets: socket (PacketSocketClient/Server) or virtual (zero-area "
+                 "packets handed to the device, counted by a protocol handler on the AP)",
+                 payload);
+    cmd.AddValue("lossCache",
+                 "Precompute the path loss between every pair of nodes (static topologies)",
+                 lossCache);
+    cmd.AddValue("bench", "Print phase wall times, event count and peak RSS", bench);
+    cmd.AddValue("estimate",
+                 "Analytical throughput estimate: off, only (no simulation) or check (printed "
+                 "next to the simulated throughput)",
+                 estimateMode);
+    cmd.AddValue("ciTarget",
+                 "Stop when the 95% CI half-width of every BSS throughput is below this "
+                 "fraction of its mean (0 runs the whole duration, which is then the cap)",
+                 ciTarget);
+    cmd.AddValue("ciBatch", "Batch length in seconds for --ciTarget", ciBatch);
+    cmd.AddValue("profile",
+                 "Write the wall time spent per event type and callback to this file",
+                 profileFile);
+    cmd.AddValue("cullMargin",
+                 "Do not deliver signals that arrive more than this many dB below the noise "
+                 "floor (negative disables)",
+                 cullMargin);
+    cmd.AddValue("snapshot",
+                 "Setup snapshot written by app=setup, read by app=setup-done",
+                 snapshotFile);
+    cmd.AddValue("optimize",
+                 "Search the ccaSensitivity maximizing throughput or fair (throughput x "
+                 "fairness) instead of running the given one (off)",
+                 optimize);
+    cmd.AddValue("optimizeMin", "Lower end of the searched CCA range in dBm", optimizeMin);
+    cmd.AddValue("optimizeMax", "Upper end of the searched CCA range in dBm", optimizeMax);
+    cmd.AddValue("optimizeTolerance",
+                 "Width of the CCA interval in dB at which the search stops",
+                 optimizeTolerance);
+    cmd.AddValue("optimizeMaxReplications",
+                 "Replications per CCA threshold above which close points are no longer refined",
+                 optimizeMaxReplications);
+    cmd.AddValue("cache",
+                 "Result cache file: a run whose options and build are already in it prints the "
+                 "cached results instead of simulating (empty disables)",
+                 cacheFile);
+    cmd.AddValue("cacheVerify",
+                 "Fraction of the cache hits simulated again and compared with the cache",
+                 cacheVerify);
+    cmd.AddValue("sweep",
+                 "Parameter grid to sweep, e.g. \"apNodes=2,3;ccaSensitivity=-82:-62:2\"",
+                 sweepGrid);
+    cmd.AddValue("sweepWorkers",
+                 "Number of sweep worker processes (0 for all cores)",
+                 sweepWorkers);
+    cmd.AddValue("sweepStore", "Sweep results store", sweepStore);
+    cmd.AddValue("sweepPrune",
+                 "Only simulate the sweep points whose analytical estimate is within this "
+                 "fraction of the best point differing only in sweepPruneBy (0 simulates all)",
+                 sweepPrune);
+    cmd.AddValue("sweepPruneBy", "Option compared by --sweepPrune", sweepPruneBy);
+    cmd.AddValue("sweepKey", "Internal: hash of the sweep point run by this worker", sweepKey);
+
+    cmd.Parse(argc, argv);
+
+    if (!sweepGrid.empty())
+    {
+        return RunSweep(argc, argv);
+    }
+
+    profiling = !profileFile.empty();
+    RngSeedManager::SetSeed(seedNumber);
+
+    if (warmup < 0)
+    {
+        warmup = (appType == "setup-done") ? 0.5 : (preassociate ? 0.1 : 10);
+    }
+    NS_ABORT_MSG_IF(replications == 0, "replications must be at least 1");
+    NS_ABORT_MSG_IF(phyTraceMode != "records" && phyTraceMode != "aggregate",
+                    "Unsupported PHY trace mode " << phyTraceMode);
+    NS_ABORT_MSG_IF(payload != "socket" && payload != "virtual",
+                    "Unsupported payload mode " << payload);
+    NS_ABORT_MSG_IF(estimateMode != "off" && estimateMode != "only" && estimateMode != "check",
+                    "Unsupported estimate mode " << estimateMode);
+    if (trafficArrivalRate > 0 && appType == "constant")
+    {
+        appType = "poisson";
+    }
+    NS_ABORT_MSG_IF(appType == "poisson" && trafficArrivalRate <= 0,
+                    "app=poisson needs a positive --trafficArrivalRate");
+    NS_ABORT_MSG_IF(appType == "bursty-trace" && trafficTrace.empty(),
+                    "app=bursty-trace needs --trafficTrace");
+    NS_ABORT_MSG_IF(phyMode == "auto" && standard != "11ax",
+                    "phyMode=auto selects HE MCSs, it needs standard=11ax");
+    NS_ABORT_MSG_IF(replications > 1 && appType == "setup",
+                    "app=setup takes a single snapshot, it cannot be replicated");
+
+    NS_ABORT_MSG_IF(optimize != "off" && optimize != "throughput" && optimize != "fair",
+                    "Unsupported optimization objective " << optimize);
+    NS_ABORT_MSG_IF(optimize != "off" && (appType == "setup" || optimizeMin >= optimizeMax ||
+                                          optimizeTolerance <= 0),
+                    "--optimize needs traffic, optimizeMin < optimizeMax and a positive "
+                    "optimizeTolerance");
+
+    if (apLayout == "poisson")
+    {
+        apMeanCount = apNodeCount;
+        apNodeCount = DrawPoissonApCount(apMeanCount);
+        std::cout << "Poisson AP layout: " << apNodeCount << " APs (mean " << apMeanCount << ")"
+                  << std::endl;
+    }
+
+    std::string cacheKey;
+    std::vector<TrialResult> cached;
+    std::string sideOutput = SideOutputOption();
+    if (!cacheFile.empty() && !sideOutput.empty())
+    {
+        std::cout << "CACHE: skipped, --" << sideOutput << " writes outputs a hit would not produce"
+                  << std::endl;
+    }
+    if (!cacheFile.empty() && optimize == "off" && appType != "setup" && sideOutput.empty())
+    {
+        // apNodes holds the drawn AP count of apLayout=poisson, the mean sets the area
+        std::string layout =
+            apMeanCount > 0 ? " apMeanCount=" + std::to_string(apMeanCount) : "";
+        cacheKey = HashString(cmd.Canonical() + layout + " inputs=" + InputHash() +
+                              " build=" + BuildHash());
+        cached = LookupCache(cacheFile, cacheKey);
+        std::random_device entropy;
+        if (!cached.empty() && std::uniform_real_distribution<>(0, 1)(entropy) >= cacheVerify)
+        {
+            std::cout << "CACHE: hit " << cacheKey << std::endl;
+            PrintCachedResults(cached);
+            if (!sweepKey.empty())
+            {
+                RecordSweepResult(argc, argv, cached);
+            }
+            if (appType == "poisson")
+            {
+                AppendArrivalResult(cached);
+            }
+            return 0;
+        }
+        std::cout << "CACHE: " << (cached.empty() ? "miss " : "verifying ") << cacheKey
+                  << std::endl;
+    }
+
+    std::vector<TrialResult> results;
+    durationCap = duration;
+    if (optimize != "off")
+    {
+        results = ReportCcaSearch(SearchCca());
+    }
+    else
+    {
+        RunReplications(0, replications, results);
+    }
+
+    if (results.size() > 1)
+    {
+        PrintReplicationSummary(results);
+    }
+
+    if (profiling)
+    {
+        profiling = false;
+        WriteProfile(profileFile);
+    }
 
-// // Function to calculate throughput and success probability for each BSS
-// void CalculateThroughputAndSuccess(int numBSS, std::vector<int> successes, int payloadSize, double simulationTime) {
-//     for (int bss = 0; bss < numBSS; ++bss) {
-//         double successProbability = static_cast<double>(successes[bss]) / (successes[bss] + 1e-9); // Avoid division by zero
-//         double throughput = static_cast<double>(successes[bss]) * payloadSize * 8 / simulationTime; // In bits/sec
-//         std::cout << "BSS " << bss + 1 << ": Throughput = " << throughput / 1e6 << " Mbps, "
-//                   << "Success Probability = " << successProbability << std::endl;
-//     }
-// }
+    if (!cacheKey.empty())
+    {
+        double difference = cached.empty() ? 0 : ResultsDifference(cached, results);
+        if (!cached.empty())
+        {
+            std::cout << "CACHE: " << (difference > 1e-9 ? "MISMATCH" : "verified")
+                      << ", largest relative difference " << difference << std::endl;
+        }
+        if (cached.empty() || difference > 1e-9)
+        {
+            AppendSweepStore(cacheFile,
+                             cacheKey + "\t" + cmd.Canonical() + "\t" +
+                                 SerializeResults(results) + "\n");
+        }
+    }
 
-// // Example integration within the simulation
-// std::vector<int> successes = {100, 120, 110}; // Example: Replace with actual success data for each BSS
-// int payloadSize = 1500; // Example payload size in bytes
-// double simulationTime = 10.0; // Example simulation time in seconds
-// CalculateThroughputAndSuccess(successes.size(), successes, payloadSize, simulationTime);
+    if (!sweepKey.empty())
+    {
+        RecordSweepResult(argc,
+                          argv,
+                          results,
+                          optimize != "off" ? " ccaOptimum=" + std::to_string(ccaSensitivity)
+                                            : "");
+    }
+    if (appType == "poisson")
+    {
+        AppendArrivalResult(results);
+    }
 
-    
+    return 0;
+}
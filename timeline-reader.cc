@@ -0,0 +1,136 @@
+/* -*-  Mode: C++; c-file-style: "gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * Copyright (c) 2022
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+/*
+ * Summary and CSV export of a binary PPDU timeline (tx-timeline.bin). Does not depend on ns-3:
+ *
+ *   g++ -O2 -std=c++17 -o timeline-reader timeline-reader.cc
+ *   ./timeline-reader tx-timeline.bin          # columns, record count, per-reason totals
+ *   ./timeline-reader tx-timeline.bin --csv    # one line per record, same columns as
+ *                                              # tx-timeline.txt plus receiver and MPDU counts
+ */
+
+#include "tx-timeline-format.h"
+
+#include <cstdio>
+#include <cstring>
+#include <map>
+
+namespace
+{
+
+const char*
+ColumnTypeName(uint8_t type)
+{
+    switch (type)
+    {
+    case TIMELINE_I64:
+        return "int64";
+    case TIMELINE_U64:
+        return "uint64";
+    case TIMELINE_U32:
+        return "uint32";
+    case TIMELINE_U16:
+        return "uint16";
+    default:
+        return "?";
+    }
+}
+
+void
+PrintSummary(const TimelineMap& timeline)
+{
+    const TimelineFileHeader& header = timeline.Header();
+    std::printf("Records: %zu%s\n",
+                timeline.GetNRecords(),
+                timeline.IsComplete() ? "" : " (run did not finish)");
+    std::printf("Record size: %u bytes, data at offset %u\n", header.recordSize, header.headerSize);
+    for (uint32_t i = 0; i < header.nColumns && i < TIMELINE_MAX_COLUMNS; i++)
+    {
+        const TimelineColumn& column = header.columns[i];
+        std::printf("  %-12s %-7s offset %2u x%u\n",
+                    column.name,
+                    ColumnTypeName(column.type),
+                    column.offset,
+                    column.count);
+    }
+
+    uint64_t mpdus = 0;
+    uint64_t failed = 0;
+    std::map<uint16_t, uint64_t> perReason;
+    for (const TimelineRecord& record : timeline)
+    {
+        perReason[record.reason]++;
+        mpdus += record.nMpdus;
+        failed += record.nFailed;
+    }
+    std::printf("MPDUs: %llu, failed: %llu\n",
+                static_cast<unsigned long long>(mpdus),
+                static_cast<unsigned long long>(failed));
+    for (const auto& [reason, count] : perReason)
+    {
+        std::printf("  %-24s %llu\n",
+                    reason == 0 ? "received" : timeline.ReasonName(reason).c_str(),
+                    static_cast<unsigned long long>(count));
+    }
+}
+
+void
+PrintCsv(const TimelineMap& timeline)
+{
+    std::printf("Start Time,End Time,Source Node,Receiver Node,DropReason,MPDUs,Failed MPDUs\n");
+    for (const TimelineRecord& record : timeline)
+    {
+        std::printf("%lld,%lld,%u,%u,%s,%u,%u\n",
+                    static_cast<long long>(record.startNs),
+                    static_cast<long long>(record.endNs),
+                    record.senderId,
+                    record.receiverId,
+                    timeline.ReasonName(record.reason).c_str(),
+                    record.nMpdus,
+                    record.nFailed);
+    }
+}
+
+} // namespace
+
+int
+main(int argc, char* argv[])
+{
+    if (argc < 2 || (argc > 2 && std::strcmp(argv[2], "--csv") != 0))
+    {
+        std::fprintf(stderr, "usage: %s <tx-timeline.bin> [--csv]\n", argv[0]);
+        return 2;
+    }
+    TimelineMap timeline;
+    if (!timeline.Open(argv[1]))
+    {
+        std::fprintf(stderr, "%s\n", timeline.GetError().c_str());
+        return 1;
+    }
+    if (argc > 2)
+    {
+        PrintCsv(timeline);
+    }
+    else
+    {
+        PrintSummary(timeline);
+    }
+    return 0;
+}
@@ -0,0 +1,254 @@
+/* -*-  Mode: C++; c-file-style: "gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * Copyright (c) 2022
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+/*
+ * Layout of tx-timeline.bin, the binary PPDU reception timeline written by multiupdated.cc with
+ * --timelineFormat=binary, and a small reader that maps it in memory.
+ *
+ * The file is a TimelineFileHeader followed by fixed-width TimelineRecord entries, all little
+ * endian. The header lists every column (name, type, byte offset) and the names of the drop
+ * reason codes, so the records can be used without parsing, e.g. from numpy with
+ * np.memmap(path, dtype=<dtype built from the columns>, offset=headerSize).
+ * nRecords is written when the run ends; a file from an interrupted run has nRecords = 0 and
+ * holds (fileSize - headerSize) / recordSize complete records.
+ */
+
+#ifndef TX_TIMELINE_FORMAT_H
+#define TX_TIMELINE_FORMAT_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/// One PPDU reception outcome at one receiver
+struct TimelineRecord
+{
+    int64_t startNs;        ///< Reception start (ns)
+    int64_t endNs;          ///< Reception end (ns)
+    uint32_t senderId;      ///< Node id of the transmitter
+    uint32_t receiverId;    ///< Node id of the receiver
+    uint16_t reason;        ///< WifiPhyRxfailureReason, 0 if the PPDU was not dropped
+    uint16_t nMpdus;        ///< Number of MPDUs in the PSDU (0 if dropped)
+    uint16_t nFailed;       ///< Number of MPDUs that failed to decode
+    uint16_t reserved;      ///< Padding, always 0
+    uint64_t mpduStatus[4]; ///< Bit i set if MPDU i was decoded (m_statusPerMpdu)
+};
+
+static_assert(sizeof(TimelineRecord) == 64, "TimelineRecord must stay 64 bytes");
+
+/// Column types used in the column table
+enum TimelineColumnType : uint8_t
+{
+    TIMELINE_I64 = 0,
+    TIMELINE_U64 = 1,
+    TIMELINE_U32 = 2,
+    TIMELINE_U16 = 3,
+};
+
+/// One entry of the column table
+struct TimelineColumn
+{
+    char name[23];   ///< NUL terminated column name
+    uint8_t type;    ///< TimelineColumnType
+    uint32_t offset; ///< Byte offset in the record
+    uint32_t count;  ///< Number of consecutive values (4 for mpduStatus)
+};
+
+constexpr char TIMELINE_MAGIC[8] = {'M', 'B', 'S', 'S', 'T', 'L', 'N', '1'};
+constexpr uint32_t TIMELINE_VERSION = 1;
+constexpr uint32_t TIMELINE_MAX_COLUMNS = 16;
+constexpr uint32_t TIMELINE_MAX_REASONS = 64;
+constexpr uint32_t TIMELINE_REASON_NAME = 32; ///< Bytes per reason name
+
+/// File header, followed directly by the records
+struct TimelineFileHeader
+{
+    char magic[8];       ///< TIMELINE_MAGIC
+    uint32_t version;    ///< TIMELINE_VERSION
+    uint32_t headerSize; ///< sizeof(TimelineFileHeader), the offset of the first record
+    uint32_t recordSize; ///< sizeof(TimelineRecord)
+    uint32_t nColumns;   ///< Valid entries in columns
+    uint64_t nRecords;   ///< Number of records, 0 if the run did not finish
+    TimelineColumn columns[TIMELINE_MAX_COLUMNS];
+    char reasonNames[TIMELINE_MAX_REASONS][TIMELINE_REASON_NAME]; ///< Drop reason -> name
+};
+
+/// Header describing the TimelineRecord columns, with no record and no reason name yet
+inline TimelineFileHeader
+MakeTimelineHeader()
+{
+    TimelineFileHeader header;
+    std::memset(&header, 0, sizeof(header));
+    std::memcpy(header.magic, TIMELINE_MAGIC, sizeof(header.magic));
+    header.version = TIMELINE_VERSION;
+    header.headerSize = sizeof(TimelineFileHeader);
+    header.recordSize = sizeof(TimelineRecord);
+    const TimelineColumn columns[] = {
+        {"startNs", TIMELINE_I64, offsetof(TimelineRecord, startNs), 1},
+        {"endNs", TIMELINE_I64, offsetof(TimelineRecord, endNs), 1},
+        {"senderId", TIMELINE_U32, offsetof(TimelineRecord, senderId), 1},
+        {"receiverId", TIMELINE_U32, offsetof(TimelineRecord, receiverId), 1},
+        {"reason", TIMELINE_U16, offsetof(TimelineRecord, reason), 1},
+        {"nMpdus", TIMELINE_U16, offsetof(TimelineRecord, nMpdus), 1},
+        {"nFailed", TIMELINE_U16, offsetof(TimelineRecord, nFailed), 1},
+        {"reserved", TIMELINE_U16, offsetof(TimelineRecord, reserved), 1},
+        {"mpduStatus", TIMELINE_U64, offsetof(TimelineRecord, mpduStatus), 4},
+    };
+    header.nColumns = sizeof(columns) / sizeof(columns[0]);
+    std::memcpy(header.columns, columns, sizeof(columns));
+    return header;
+}
+
+/**
+ * Read-only memory mapping of a tx-timeline.bin file. The records are used in place, nothing
+ * is parsed or copied.
+ */
+class TimelineMap
+{
+  public:
+    TimelineMap() = default;
+    TimelineMap(const TimelineMap&) = delete;
+    TimelineMap& operator=(const TimelineMap&) = delete;
+
+    ~TimelineMap()
+    {
+        Close();
+    }
+
+    /// Map the file; returns false and sets the error message if it is not a valid timeline
+    bool Open(const std::string& path)
+    {
+        Close();
+        int fd = open(path.c_str(), O_RDONLY);
+        if (fd < 0)
+        {
+            m_error = "cannot open " + path;
+            return false;
+        }
+        struct stat st;
+        if (fstat(fd, &st) != 0 ||
+            static_cast<std::size_t>(st.st_size) < sizeof(TimelineFileHeader))
+        {
+            close(fd);
+            m_error = path + " is too short to be a timeline";
+            return false;
+        }
+        m_size = st.st_size;
+        m_data = mmap(nullptr, m_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        close(fd);
+        if (m_data == MAP_FAILED)
+        {
+            m_data = nullptr;
+            m_error = "cannot map " + path;
+            return false;
+        }
+        const TimelineFileHeader& header = Header();
+        if (std::memcmp(header.magic, TIMELINE_MAGIC, sizeof(header.magic)) != 0 ||
+            header.version != TIMELINE_VERSION || header.recordSize != sizeof(TimelineRecord) ||
+            header.headerSize != sizeof(TimelineFileHeader))
+        {
+            Close();
+            m_error = path + " is not a version " + std::to_string(TIMELINE_VERSION) + " timeline";
+            return false;
+        }
+        m_nRecords = (m_size - header.headerSize) / header.recordSize;
+        if (header.nRecords != 0 && header.nRecords < m_nRecords)
+        {
+            m_nRecords = header.nRecords;
+        }
+        return true;
+    }
+
+    void Close()
+    {
+        if (m_data)
+        {
+            munmap(m_data, m_size);
+        }
+        m_data = nullptr;
+        m_size = 0;
+        m_nRecords = 0;
+    }
+
+    const TimelineFileHeader& Header() const
+    {
+        return *static_cast<const TimelineFileHeader*>(m_data);
+    }
+
+    /// Whether the run that wrote the file finished (nRecords was written)
+    bool IsComplete() const
+    {
+        return Header().nRecords != 0;
+    }
+
+    std::size_t GetNRecords() const
+    {
+        return m_nRecords;
+    }
+
+    const TimelineRecord* begin() const
+    {
+        return reinterpret_cast<const TimelineRecord*>(static_cast<const char*>(m_data) +
+                                                       Header().headerSize);
+    }
+
+    const TimelineRecord* end() const
+    {
+        return begin() + m_nRecords;
+    }
+
+    const TimelineRecord& operator[](std::size_t i) const
+    {
+        return begin()[i];
+    }
+
+    /// Name of a drop reason code ("" for 0, the code itself if it was never named)
+    std::string ReasonName(uint16_t reason) const
+    {
+        if (reason == 0)
+        {
+            return "";
+        }
+        if (reason < TIMELINE_MAX_REASONS && Header().reasonNames[reason][0] != '\0')
+        {
+            return std::string(Header().reasonNames[reason],
+                               strnlen(Header().reasonNames[reason], TIMELINE_REASON_NAME));
+        }
+        return std::to_string(reason);
+    }
+
+    const std::string& GetError() const
+    {
+        return m_error;
+    }
+
+  private:
+    void* m_data{nullptr};     ///< Start of the mapping
+    std::size_t m_size{0};     ///< Size of the mapping
+    std::size_t m_nRecords{0}; ///< Complete records in the file
+    std::string m_error;       ///< Reason of the last Open failure
+};
+
+#endif /* TX_TIMELINE_FORMAT_H */
@@ -38,7 +38,7 @@ def main():
     min_lambda = -4
     max_lambda = -1
     step_size = 1
-    lambdas = []
+    lambdas = [10 ** lam for lam in range(min_lambda, max_lambda + 1, step_size)]
     bss_range = range(2, 6)  # Iterating over BSSs 2 to 5
 
     # Data storage for plotting
@@ -46,9 +46,7 @@ def main():
 
     # Run the ns3 simulation for each BSS and λ
     for bss_count in bss_range:
-        for lam in range(min_lambda, max_lambda + 1, step_size):
-            lambda_val = 10 ** lam
-            lambdas.append(lambda_val) if lam == min_lambda else None
+        for lambda_val in lambdas:
             cmd = (f"./ns3 run 'multi-bss-throughput-updated --rngRun={rng_run} "
                    f"--numBSS={bss_count} --ccaPdThreshold={fixed_cca_pd} "
                    f"--trafficArrivalRate={lambda_val}'")
@@ -58,8 +56,9 @@ def main():
         with open('multi-bss.dat', 'r') as f:
             lines = f.readlines()
             for line in lines:
+                # <lambda>,<throughput>,<throughputCi>,<fairness>,<numBSS>,...
                 tokens = line.split(',')
-                if len(tokens) > 1:  # Assuming format: <lambda>,<throughput>
+                if len(tokens) > 4 and int(tokens[4]) == bss_count:
                     aggregate_throughput[bss_count].append(float(tokens[1]))
 
     # Plot the results